@@ -5,6 +5,7 @@
 #include "config.h"
 #include "audio_manager.h"
 
+#include "core/jobsystem.h"
 #include "core/maths.h"
 #include "core/random.h"
 #include "physics/phy.h"
@@ -14,7 +15,7 @@
 
 namespace Audio {
 
-    AudioManager::AudioManager() {
+    AudioManager::AudioManager() : m_physics_world(&Physics::get_world()) {
         m_soloud.init();
         m_soloud.setMaxActiveVoiceCount(MAX_VOICES_PER_EMITTER);
 
@@ -26,6 +27,11 @@ namespace Audio {
         m_soloud.set3dListenerPosition(0, 0, 0);
         m_soloud.set3dListenerUp(0, 1, 0);
         m_soloud.set3dListenerAt(0, 0, -1);
+
+        // every ray spawns at most one reflected ray, so a wave never outgrows the primary wave
+        m_queued_rays.init(NUM_PRIMARY_RAYS);
+        m_next_rays.init(NUM_PRIMARY_RAYS);
+        m_trace_results.resize(NUM_PRIMARY_RAYS);
     }
 
     AudioManager::~AudioManager() {
@@ -37,6 +43,10 @@ namespace Audio {
         m_emitter.m_self_collider = cid;
     }
 
+    void AudioManager::set_physics_world(const Physics::World& world) {
+        m_physics_world = &world;
+    }
+
     void AudioManager::update_listener_pos_and_at(const glm::vec3& position, const glm::quat& rot) {
         m_listener.m_position = position;
         m_listener.m_rotation = rot;
@@ -53,12 +63,15 @@ namespace Audio {
 
     void AudioManager::update() {
         m_soloud.update3dAudio();
+        trace();
+        m_emitter.update(m_soloud);
+    }
+
+    void AudioManager::trace() {
         m_emitter.reset_voices();
 
         // _direct_los_stage();
         _indirect_stage();
-
-        m_emitter.update(m_soloud);
     }
 
     void AudioManager::_direct_los_stage() {
@@ -69,40 +82,61 @@ namespace Audio {
     }
 
     void AudioManager::_indirect_stage() {
-        for (auto i = 0; i < 1024; ++i) {
-            this->m_queued_rays.emplace_back(m_emitter.m_position, Core::RandomPointOnUnitSphere());
+        this->m_queued_rays.clear();
+        for (auto i = 0; i < NUM_PRIMARY_RAYS; ++i) {
+            this->m_queued_rays.push(Physics::Ray(m_emitter.m_position, Core::RandomPointOnUnitSphere()));
         }
 
+        // trace in waves, every bounce depth is sorted for coherence before it is traversed
         while (!this->m_queued_rays.empty()) {
-            const auto ray = this->m_queued_rays.front();
-            this->m_queued_rays.pop_front();
-
-            if (Physics::HitInfo hit_info;
-                Physics::cast_ray(ray, hit_info, Physics::CollisionMask::Audio)) {
-                const auto new_ray_pos = hit_info.pos + Physics::epsilon_f * hit_info.norm;
+            this->m_queued_rays.sort();
+            this->m_next_rays.clear();
+
+            // the rays of a wave only read the scene, they are traced on the job pool and their
+            // bounces and voices are applied afterwards so the result doesn't depend on the thread count
+            const auto num_rays = this->m_queued_rays.size();
+            Core::JobSystem::Get().ParallelFor(
+                num_rays, RAY_TRACE_GRAIN, [this](const std::size_t begin, const std::size_t end) {
+                    for (auto i = begin; i < end; ++i) {
+                        _trace_ray(this->m_queued_rays[i], this->m_trace_results[i]);
+                    }
+                });
+
+            for (std::size_t i = 0; i < num_rays; ++i) {
+                const auto& ray = this->m_queued_rays[i];
+                const auto& result = this->m_trace_results[i];
+                if (!result.hit) { continue; }
                 if (ray.bounces < Physics::MAX_RAY_BOUNCES) {
-                    const auto new_ray = Physics::Ray(new_ray_pos,
-                        glm::reflect(ray.dir, hit_info.norm),
-                        true,
-                        ray.bounces + 1,
-                        hit_info.t + ray.travelled);
-                    this->m_queued_rays.emplace_back(
-                            new_ray
+                    this->m_next_rays.push(
+                        Physics::Ray(result.pos, result.reflected_dir, true, ray.bounces + 1, result.travelled)
                         );
                 }
-
-                if (_has_los(m_listener.m_position, new_ray_pos)) {
-                    // Debug::DrawBox(hit_info.pos, glm::quat(), 0.1f, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-                    m_emitter.activate_voice(new_ray_pos, ray.travelled);
+                if (result.audible) {
+                    m_emitter.activate_voice(result.pos, ray.travelled);
                 }
             }
+
+            std::swap(this->m_queued_rays, this->m_next_rays);
+        }
+    }
+
+    void AudioManager::_trace_ray(const Physics::Ray& ray, TraceResult& result) const {
+        result.hit = false;
+        if (Physics::HitInfo hit_info;
+            m_physics_world->cast_ray(ray, hit_info, Physics::CollisionMask::Audio)) {
+            result.hit = true;
+            result.pos = hit_info.pos + Physics::epsilon_f * hit_info.norm;
+            result.reflected_dir = glm::reflect(ray.dir, hit_info.norm);
+            result.travelled = hit_info.t + ray.travelled;
+            // Debug::DrawBox(hit_info.pos, glm::quat(), 0.1f, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+            result.audible = _has_los(m_listener.m_position, result.pos);
         }
     }
 
     bool AudioManager::_has_los(const glm::vec3& from, const glm::vec3& to) const {
         const auto ray = Physics::Ray(from, to - from, false);
         Physics::HitInfo info;
-        auto b_res = Physics::cast_ray(ray, info, Physics::CollisionMask::Audio);
+        auto b_res = m_physics_world->cast_ray(ray, info, Physics::CollisionMask::Audio);
         return !b_res || info.collider == m_emitter.m_self_collider;
     }
 
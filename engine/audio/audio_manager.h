@@ -4,18 +4,26 @@
 
 #pragma once
 
-#include <deque>
-
 #include "soloud.h"
 
 #include "emitter.h"
 #include "listener.h"
 #include "physics/ray.h"
+#include "ray_batch.h"
+
 
+namespace Physics {
+    struct World;
+}
 
 namespace Audio {
     struct Listener;
     struct Emitter;
+
+    constexpr auto NUM_PRIMARY_RAYS{1024};
+    // rays traced per job, small enough that a wave spreads over the whole pool
+    constexpr auto RAY_TRACE_GRAIN{64};
+
     class AudioManager {
     public:
         static AudioManager& get() {
@@ -33,23 +41,44 @@ namespace Audio {
         void operator=(const AudioManager&) = delete;
 
         void set_emitter_collider(Physics::ColliderId cid);
+        // rays are traced against the shared physics world unless another one is set, a bake can
+        // trace against a private copy while the shared world keeps simulating
+        void set_physics_world(const Physics::World& world);
 
         void update_listener_pos_and_at(const glm::vec3& position, const glm::quat& rot);
         void update_emitter_position(const glm::vec3& position);
 
         void update();
+        // traces the rays of one frame and picks the voices they activate, update() runs it before
+        // mixing. it doesn't touch the mixer, so headless tools and tests can drive it directly
+        void trace();
 
     private:
         void _direct_los_stage();
         void _indirect_stage();
+        // what tracing one ray produced, applied serially in ray order once the wave is done
+        struct TraceResult {
+            bool hit = false;
+            bool audible = false;
+            glm::vec3 pos{};
+            glm::vec3 reflected_dir{};
+            float travelled = 0.0f;
+        };
+
+        void _trace_ray(const Physics::Ray& ray, TraceResult& result) const;
 
         [[nodiscard]] bool _has_los(const glm::vec3& from, const glm::vec3& to) const;
 
         SoLoud::Soloud m_soloud;
 
+        const Physics::World* m_physics_world;
+
         Listener m_listener;
         Emitter m_emitter;
 
-        std::deque<Physics::Ray> m_queued_rays;
+        // current bounce wave and the rays it spawns, swapped after every wave
+        RayBatch m_queued_rays;
+        RayBatch m_next_rays;
+        std::vector<TraceResult> m_trace_results;
     };
 } // Audio
@@ -44,6 +44,8 @@ namespace Audio {
     }
 
     void Emitter::activate_voice(const glm::vec3& pos, float travelled) {
+        // a wave with its bounces can find more audible hits than there are voices
+        if (m_voices.m_next_available_voice >= m_voices.m_data.size()) { return; }
         const auto idx = m_voices.m_next_available_voice++;
         m_voices.m_data[idx].m_position = pos;
         travelled = Math::clampf(travelled, m_min_dist, m_max_dist);
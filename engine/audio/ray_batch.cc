@@ -0,0 +1,65 @@
+﻿#include "config.h"
+#include "ray_batch.h"
+
+#include <algorithm>
+
+#include "core/maths.h"
+
+
+namespace Audio {
+
+    namespace Internal {
+
+        // spreads the lower 10 bits of v so that there are two zero bits between each
+        inline uint64_t part_1_by_2(uint64_t v) {
+            v &= 0x3ff;
+            v = (v | (v << 16)) & 0x30000ff;
+            v = (v | (v << 8)) & 0x300f00f;
+            v = (v | (v << 4)) & 0x30c30c3;
+            v = (v | (v << 2)) & 0x9249249;
+            return v;
+        }
+
+        inline uint64_t morton_3d(const uint32_t x, const uint32_t y, const uint32_t z) {
+            return part_1_by_2(x) | (part_1_by_2(y) << 1) | (part_1_by_2(z) << 2);
+        }
+
+    }
+
+    uint64_t ray_sort_key(const Physics::Ray& ray, const glm::vec3& grid_min, const glm::vec3& inv_cell_size) {
+        const auto cell = (ray.orig - grid_min) * inv_cell_size;
+        const auto to_cell = [](const float c) {
+            return static_cast<uint32_t>(Math::clampf(c, 0.0f, static_cast<float>(RAY_BATCH_GRID_RES - 1)));
+        };
+        const auto octant = static_cast<uint64_t>(
+            (ray.dir.x < 0.0f ? 1 : 0) | (ray.dir.y < 0.0f ? 2 : 0) | (ray.dir.z < 0.0f ? 4 : 0)
+            );
+        return (Internal::morton_3d(to_cell(cell.x), to_cell(cell.y), to_cell(cell.z)) << 3) | octant;
+    }
+
+    void RayBatch::init(const std::size_t capacity) {
+        m_data.reserve(capacity);
+    }
+
+    void RayBatch::push(const Physics::Ray& ray) {
+        n_assert2(m_data.size() < m_data.capacity(), "ray batch overflow");
+        m_data.push_back({0, ray});
+    }
+
+    void RayBatch::sort() {
+        if (m_data.size() < 2) { return; }
+
+        auto grid_min = glm::vec3(Physics::max_f);
+        auto grid_max = glm::vec3(-Physics::max_f);
+        for (const auto& e : m_data) {
+            grid_min = glm::min(grid_min, e.ray.orig);
+            grid_max = glm::max(grid_max, e.ray.orig);
+        }
+        const auto extent = glm::max(grid_max - grid_min, glm::vec3(Physics::epsilon_f));
+        const auto inv_cell_size = static_cast<float>(RAY_BATCH_GRID_RES) / extent;
+
+        for (auto& e : m_data) { e.key = ray_sort_key(e.ray, grid_min, inv_cell_size); }
+        std::ranges::sort(m_data, std::less{}, &Entry::key);
+    }
+
+} // Audio
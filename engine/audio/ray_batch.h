@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <vector>
+
+#include "physics/ray.h"
+
+
+namespace Audio {
+
+    // number of cells per axis used to bucket ray origins, must fit in 10 bits
+    constexpr auto RAY_BATCH_GRID_RES{1024u};
+
+    uint64_t ray_sort_key(const Physics::Ray& ray, const glm::vec3& grid_min, const glm::vec3& inv_cell_size);
+
+    // fixed capacity ray storage, allocated once and reused every frame
+    struct RayBatch {
+        struct Entry {
+            uint64_t key;
+            Physics::Ray ray;
+        };
+
+        std::vector<Entry> m_data{};
+
+        void init(std::size_t capacity);
+
+        void push(const Physics::Ray& ray);
+        void clear() { m_data.clear(); }
+
+        [[nodiscard]] bool empty() const { return m_data.empty(); }
+        [[nodiscard]] std::size_t size() const { return m_data.size(); }
+        [[nodiscard]] const Physics::Ray& operator[](const std::size_t i) const { return m_data[i].ray; }
+
+        // reorders the rays so rays starting in the same cell and heading
+        // into the same octant are traced back to back and share their bvh paths
+        void sort();
+    };
+
+} // Audio
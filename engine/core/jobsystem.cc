@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+//  jobsystem.cc
+//  @copyright (C) 2026 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "jobsystem.h"
+
+
+namespace Core {
+    /// index of the worker queue owned by the calling thread, -1 outside the pool
+    static thread_local int workerIndex = -1;
+    /// pool the calling worker belongs to, so a second pool doesn't push into the wrong queues
+    static thread_local const JobSystem* workerPool = nullptr;
+    /// jobs a worker queue holds before its ring has to grow
+    static constexpr size_t initialQueueSize = 64;
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::WorkerQueue::PushBack(Job job) {
+        if (this->count == this->jobs.size()) {
+            std::vector<Job> grown(this->jobs.empty() ? initialQueueSize : 2 * this->jobs.size());
+            for (size_t i = 0; i < this->count; ++i)
+                grown[i] = std::move(this->jobs[(this->head + i) % this->jobs.size()]);
+            this->jobs.swap(grown);
+            this->head = 0;
+        }
+        this->jobs[(this->head + this->count) % this->jobs.size()] = std::move(job);
+        ++this->count;
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    Job JobSystem::WorkerQueue::PopBack() {
+        --this->count;
+        return std::move(this->jobs[(this->head + this->count) % this->jobs.size()]);
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    Job JobSystem::WorkerQueue::PopFront() {
+        auto job = std::move(this->jobs[this->head]);
+        this->head = (this->head + 1) % this->jobs.size();
+        --this->count;
+        return job;
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    JobSystem::JobSystem(const uint numWorkers) {
+        // a pool without workers still needs a queue for the waiting thread to drain
+        const auto numQueues = numWorkers > 0 ? numWorkers : 1;
+        this->queues.reserve(numQueues);
+        for (uint i = 0; i < numQueues; ++i)
+            this->queues.push_back(std::make_unique<WorkerQueue>());
+
+        this->workers.reserve(numWorkers);
+        for (uint i = 0; i < numWorkers; ++i)
+            this->workers.emplace_back(&JobSystem::WorkerLoop, this, static_cast<int>(i));
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    JobSystem::~JobSystem() {
+        {
+            std::lock_guard lock(this->sleepMutex);
+            this->stop = true;
+        }
+        this->wake.notify_all();
+        for (auto& worker : this->workers)
+            worker.join();
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    JobSystem& JobSystem::Get() {
+        static JobSystem instance(
+            std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0
+            );
+        return instance;
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    uint JobSystem::NumWorkers() const {
+        return static_cast<uint>(this->workers.size());
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::Run(std::function<void()> func, JobCounter* counter, JobCounter* dependency) {
+        if (counter != nullptr)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        Job job{std::move(func), counter};
+        if (dependency != nullptr) {
+            // checked under the dependency lock, Release empties the list under the same lock
+            std::lock_guard lock(dependency->mutex);
+            if (dependency->pending.load(std::memory_order_acquire) > 0) {
+                dependency->dependents.push_back(std::move(job));
+                return;
+            }
+        }
+        this->Push(std::move(job));
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::Wait(JobCounter* counter) {
+        const auto home = workerPool == this ? workerIndex : -1;
+        while (counter->pending.load(std::memory_order_acquire) > 0) {
+            Job job;
+            if (this->TryPop(home, job))
+                this->Execute(job);
+            else
+                std::this_thread::yield();
+        }
+        // the last Release still holds the counter lock when pending hits zero, let it leave before returning
+        std::lock_guard lock(counter->mutex);
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::ParallelFor(
+        const size_t count, size_t grain, const std::function<void(size_t, size_t)>& func, const uint maxThreads
+        ) {
+        if (count == 0)
+            return;
+        if (grain == 0)
+            grain = 1;
+
+        const auto numRanges = (count + grain - 1) / grain;
+        auto numThreads = static_cast<size_t>(this->NumWorkers()) + 1;
+        if (maxThreads > 0 && maxThreads < numThreads)
+            numThreads = maxThreads;
+        if (numRanges < numThreads)
+            numThreads = numRanges;
+
+        if (numThreads <= 1) {
+            for (size_t begin = 0; begin < count; begin += grain)
+                func(begin, begin + grain < count ? begin + grain : count);
+            return;
+        }
+
+        // ranges are handed out from a shared cursor, a thread that finishes early just grabs the next one
+        std::atomic<size_t> next{0};
+        const auto body = [&next, &func, count, grain]() {
+            for (;;) {
+                const auto begin = next.fetch_add(grain, std::memory_order_relaxed);
+                if (begin >= count)
+                    return;
+                func(begin, begin + grain < count ? begin + grain : count);
+            }
+        };
+
+        // the jobs only hold a reference to body, small enough for std::function to store without allocating
+        JobCounter counter;
+        for (size_t t = 1; t < numThreads; ++t)
+            this->Run([&body]() { body(); }, &counter);
+        body();
+        this->Wait(&counter);
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::WorkerLoop(const int index) {
+        workerIndex = index;
+        workerPool = this;
+        for (;;) {
+            Job job;
+            if (this->TryPop(index, job)) {
+                this->Execute(job);
+                continue;
+            }
+
+            std::unique_lock lock(this->sleepMutex);
+            this->wake.wait(lock, [this]() {
+                return this->stop || this->queued.load(std::memory_order_acquire) > 0;
+            });
+            if (this->stop && this->queued.load(std::memory_order_acquire) == 0)
+                return;
+        }
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::Push(Job job) {
+        const auto index = workerPool == this
+            ? static_cast<uint>(workerIndex)
+            : this->nextQueue.fetch_add(1, std::memory_order_relaxed) % static_cast<uint>(this->queues.size());
+        {
+            auto& queue = *this->queues[index];
+            std::lock_guard lock(queue.mutex);
+            queue.PushBack(std::move(job));
+        }
+        this->queued.fetch_add(1, std::memory_order_release);
+
+        // taking the lock orders the increment before a worker checks it on its way to sleep
+        {
+            std::lock_guard lock(this->sleepMutex);
+        }
+        this->wake.notify_one();
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    bool JobSystem::TryPop(const int home, Job& job) {
+        if (this->queued.load(std::memory_order_acquire) <= 0)
+            return false;
+
+        const auto numQueues = static_cast<int>(this->queues.size());
+        if (home >= 0) {
+            auto& queue = *this->queues[home];
+            std::lock_guard lock(queue.mutex);
+            if (queue.count > 0) {
+                job = queue.PopBack();
+                this->queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        const auto first = home >= 0 ? home + 1 : 0;
+        for (auto i = 0; i < numQueues; ++i) {
+            auto& queue = *this->queues[(first + i) % numQueues];
+            std::lock_guard lock(queue.mutex);
+            if (queue.count > 0) {
+                job = queue.PopFront();
+                this->queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::Execute(Job& job) {
+        job.func();
+        if (job.counter != nullptr)
+            this->Release(job.counter);
+    }
+
+    //------------------------------------------------------------------------------
+    /**
+    */
+    void JobSystem::Release(JobCounter* counter) {
+        std::vector<Job> ready;
+        {
+            std::lock_guard lock(counter->mutex);
+            if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                ready.swap(counter->dependents);
+        }
+        // a waiter may destroy the counter once it gets the lock, it is not touched past this point
+        for (auto& job : ready)
+            this->Push(std::move(job));
+    }
+} // namespace Core
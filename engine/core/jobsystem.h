@@ -0,0 +1,109 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file jobsystem.h
+
+    Contains a work stealing thread pool shared by the engine subsystems
+
+    @class Core::JobSystem
+
+    Every worker owns a queue, it pops its own jobs from the back and steals
+    from the front of the other queues when it runs dry. Jobs queued from a
+    thread outside the pool are spread over the worker queues.
+
+    A thread waiting on a Core::JobCounter executes queued jobs until the
+    counter reaches zero, so the main thread helps out instead of blocking.
+    A pool created without workers runs every job on the waiting thread.
+
+    @copyright
+    (C) 2026 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Core {
+    struct JobCounter;
+
+    /// A queued unit of work
+    struct Job {
+        std::function<void()> func;
+        /// decremented once func has returned, may be null
+        JobCounter* counter = nullptr;
+    };
+
+    /// Number of unfinished jobs in a group, jobs depending on the group are held here until it reaches zero
+    struct JobCounter {
+        std::atomic<int> pending{0};
+        std::mutex mutex;
+        std::vector<Job> dependents;
+    };
+
+    class JobSystem {
+    public:
+        /// start numWorkers threads, the thread waiting on a counter helps as well
+        explicit JobSystem(uint numWorkers);
+        /// finish the queued jobs and join the workers
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        void operator=(const JobSystem&) = delete;
+
+        /// get the shared pool, created on first use with one worker per hardware thread besides the caller
+        static JobSystem& Get();
+
+        /// number of worker threads
+        [[nodiscard]] uint NumWorkers() const;
+        /// queue a job, the counter is incremented now and decremented once the job is done.
+        /// if dependency is given the job is held back until the dependency reaches zero
+        void Run(std::function<void()> func, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+        /// block until the counter reaches zero, executing queued jobs meanwhile
+        void Wait(JobCounter* counter);
+        /// call func(begin, end) for consecutive ranges of grain elements covering [0, count).
+        /// ranges always start at a multiple of grain, begin / grain can be used as a stable chunk index.
+        /// maxThreads limits the threads working on the loop including the caller, 0 uses the whole pool.
+        /// returns once every range is done
+        void ParallelFor(
+            size_t count, size_t grain, const std::function<void(size_t, size_t)>& func, uint maxThreads = 0
+            );
+
+    private:
+        /// jobs of one worker in a ring that only ever grows, queuing doesn't allocate once it is large enough
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::vector<Job> jobs;
+            size_t head = 0;
+            size_t count = 0;
+
+            void PushBack(Job job);
+            Job PopBack();
+            Job PopFront();
+        };
+
+        /// worker thread entry point
+        void WorkerLoop(int index);
+        /// push a runnable job to the queue of the calling worker, or the next queue in turn
+        void Push(Job job);
+        /// pop from the home queue, then steal from the others
+        bool TryPop(int home, Job& job);
+        /// run a job and release its counter
+        void Execute(Job& job);
+        /// decrement a counter and queue its dependents once it reaches zero
+        void Release(JobCounter* counter);
+
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<uint> nextQueue{0};
+        /// jobs sitting in the queues, workers sleep while this is zero
+        std::atomic<int> queued{0};
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stop = false;
+    };
+} // namespace Core
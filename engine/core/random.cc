@@ -14,17 +14,38 @@ namespace Core {
         float f;
     };
 
+    // These are predefined to give us the largest
+    // possible sequence of random numbers
+    static uint x = 123456789;
+    static uint y = 362436069;
+    static uint z = 521288629;
+    static uint w = 88675123;
+
+    //------------------------------------------------------------------------------
+    /**
+    The seed is spread over the four words with splitmix32,
+    xorshift never leaves the all zero state so that one is skipped.
+*/
+    void RandomSeed(uint seed) {
+        const auto next = [&seed]() {
+            uint v = seed += 0x9E3779B9;
+            v = (v ^ (v >> 16)) * 0x85EBCA6B;
+            v = (v ^ (v >> 13)) * 0xC2B2AE35;
+            return v ^ (v >> 16);
+        };
+        x = next();
+        y = next();
+        z = next();
+        w = next();
+        if ((x | y | z | w) == 0)
+            w = 88675123;
+    }
+
     //------------------------------------------------------------------------------
     /**
     XorShift128 implementation.
 */
     uint FastRandom() {
-        // These are predefined to give us the largest
-        // possible sequence of random numbers
-        static uint x = 123456789;
-        static uint y = 362436069;
-        static uint z = 521288629;
-        static uint w = 88675123;
         uint t = x ^ (x << 11);
         x = y;
         y = z;
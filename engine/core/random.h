@@ -11,6 +11,9 @@
 //------------------------------------------------------------------------------
 
 namespace Core {
+    /// Restart the sequence of every random function from a seed, equal seeds give equal sequences.
+    void RandomSeed(uint seed);
+
     /// Produces an xorshift128 pseudo random number.
     uint FastRandom();
 
@@ -0,0 +1,259 @@
+﻿#include "config.h"
+#include "aabbtree.h"
+
+#include "core/jobsystem.h"
+#include "core/maths.h"
+
+
+namespace Physics {
+
+    uint32_t AABBTree::allocate_node() {
+        if (this->m_free_list == null_node) {
+            this->m_nodes.emplace_back();
+            return static_cast<uint32_t>(this->m_nodes.size() - 1);
+        }
+        const auto node = this->m_free_list;
+        this->m_free_list = this->m_nodes[node].left;
+        this->m_nodes[node] = Node();
+        return node;
+    }
+
+    void AABBTree::free_node(const uint32_t node) {
+        this->m_nodes[node].left = this->m_free_list;
+        this->m_nodes[node].height = -1;
+        this->m_free_list = node;
+    }
+
+    void AABBTree::insert_leaf(const uint32_t leaf) {
+        if (this->m_root == null_node) {
+            this->m_root = leaf;
+            this->m_nodes[leaf].parent = null_node;
+            return;
+        }
+
+        // descend towards the sibling with the lowest surface area increase
+        const auto leaf_aabb = this->m_nodes[leaf].aabb;
+        auto index = this->m_root;
+        while (!this->m_nodes[index].leaf()) {
+            const auto& node = this->m_nodes[index];
+            const auto area = node.aabb.area();
+            const auto combined_area = combine(node.aabb, leaf_aabb).area();
+
+            const auto cost = 2.0f * combined_area;
+            const auto inheritance_cost = 2.0f * (combined_area - area);
+
+            const auto child_cost = [&](const uint32_t child) {
+                const auto& c = this->m_nodes[child];
+                const auto new_area = combine(c.aabb, leaf_aabb).area();
+                return (c.leaf() ? new_area : new_area - c.aabb.area()) + inheritance_cost;
+            };
+            const auto cost_left = child_cost(node.left);
+            const auto cost_right = child_cost(node.right);
+
+            if (cost < cost_left && cost < cost_right) { break; }
+            index = cost_left < cost_right ? node.left : node.right;
+        }
+
+        const auto sibling = index;
+        const auto old_parent = this->m_nodes[sibling].parent;
+        const auto new_parent = allocate_node();
+        auto& np = this->m_nodes[new_parent];
+        np.parent = old_parent;
+        np.aabb = combine(leaf_aabb, this->m_nodes[sibling].aabb);
+        np.height = this->m_nodes[sibling].height + 1;
+        np.left = sibling;
+        np.right = leaf;
+        this->m_nodes[sibling].parent = new_parent;
+        this->m_nodes[leaf].parent = new_parent;
+
+        if (old_parent != null_node) {
+            auto& op = this->m_nodes[old_parent];
+            (op.left == sibling ? op.left : op.right) = new_parent;
+        }
+        else {
+            this->m_root = new_parent;
+        }
+
+        refit_upwards(new_parent);
+    }
+
+    void AABBTree::remove_leaf(const uint32_t leaf) {
+        if (leaf == this->m_root) {
+            this->m_root = null_node;
+            return;
+        }
+
+        const auto parent = this->m_nodes[leaf].parent;
+        const auto grand_parent = this->m_nodes[parent].parent;
+        const auto sibling = this->m_nodes[parent].left == leaf ? this->m_nodes[parent].right : this->m_nodes[parent].left;
+
+        if (grand_parent != null_node) {
+            auto& gp = this->m_nodes[grand_parent];
+            (gp.left == parent ? gp.left : gp.right) = sibling;
+            this->m_nodes[sibling].parent = grand_parent;
+            free_node(parent);
+            refit_upwards(grand_parent);
+        }
+        else {
+            this->m_root = sibling;
+            this->m_nodes[sibling].parent = null_node;
+            free_node(parent);
+        }
+    }
+
+    void AABBTree::refit_upwards(uint32_t node) {
+        while (node != null_node) {
+            node = balance(node);
+            auto& n = this->m_nodes[node];
+            const auto& l = this->m_nodes[n.left];
+            const auto& r = this->m_nodes[n.right];
+            n.height = 1 + Math::max(l.height, r.height);
+            n.aabb = combine(l.aabb, r.aabb);
+            node = n.parent;
+        }
+    }
+
+    // rotates the taller grandchild up if the subtree at a is out of balance, returns the new subtree root
+    uint32_t AABBTree::balance(const uint32_t a) {
+        auto& na = this->m_nodes[a];
+        if (na.leaf() || na.height < 2) { return a; }
+
+        const auto b = na.left;
+        const auto c = na.right;
+        const auto diff = this->m_nodes[c].height - this->m_nodes[b].height;
+
+        const auto rotate_up = [&](const uint32_t up, const uint32_t other, const bool up_is_right) {
+            auto& nu = this->m_nodes[up];
+            const auto f = nu.left;
+            const auto g = nu.right;
+
+            nu.left = a;
+            nu.parent = na.parent;
+            na.parent = up;
+            if (nu.parent != null_node) {
+                auto& p = this->m_nodes[nu.parent];
+                (p.left == a ? p.left : p.right) = up;
+            }
+            else {
+                this->m_root = up;
+            }
+
+            // the taller grandchild stays with up, the shorter one moves down to a
+            const auto keep = this->m_nodes[f].height > this->m_nodes[g].height ? f : g;
+            const auto give = keep == f ? g : f;
+            nu.right = keep;
+            (up_is_right ? na.right : na.left) = give;
+            this->m_nodes[give].parent = a;
+
+            na.aabb = combine(this->m_nodes[other].aabb, this->m_nodes[give].aabb);
+            na.height = 1 + Math::max(this->m_nodes[other].height, this->m_nodes[give].height);
+            nu.aabb = combine(na.aabb, this->m_nodes[keep].aabb);
+            nu.height = 1 + Math::max(na.height, this->m_nodes[keep].height);
+            return up;
+        };
+
+        if (diff > 1) { return rotate_up(c, b, true); }
+        if (diff < -1) { return rotate_up(b, c, false); }
+        return a;
+    }
+
+    void AABBTree::insert(const uint32_t body, const AABB& aabb) {
+        if (body >= this->m_leaves.size()) { this->m_leaves.resize(body + 1, null_node); }
+        assert(this->m_leaves[body] == null_node);
+
+        const auto leaf = allocate_node();
+        auto& n = this->m_nodes[leaf];
+        n.aabb = aabb;
+        n.aabb.min_bound -= glm::vec3(fat_margin);
+        n.aabb.max_bound += glm::vec3(fat_margin);
+        n.body = body;
+        n.height = 0;
+        this->m_leaves[body] = leaf;
+        insert_leaf(leaf);
+    }
+
+    void AABBTree::remove(const uint32_t body) {
+        assert(contains(body));
+        const auto leaf = this->m_leaves[body];
+        remove_leaf(leaf);
+        free_node(leaf);
+        this->m_leaves[body] = null_node;
+    }
+
+    void AABBTree::remove_body(const uint32_t body, const uint32_t last) {
+        if (contains(body)) { remove(body); }
+        if (last == body || !contains(last)) { return; }
+
+        const auto leaf = this->m_leaves[last];
+        this->m_nodes[leaf].body = body;
+        this->m_leaves[body] = leaf;
+        this->m_leaves[last] = null_node;
+    }
+
+    bool AABBTree::update(const uint32_t body, const AABB& aabb) {
+        if (!contains(body)) {
+            insert(body, aabb);
+            return true;
+        }
+
+        const auto leaf = this->m_leaves[body];
+        if (this->m_nodes[leaf].aabb.contains(aabb)) { return false; }
+
+        remove_leaf(leaf);
+        auto& n = this->m_nodes[leaf];
+        n.aabb = aabb;
+        n.aabb.min_bound -= glm::vec3(fat_margin);
+        n.aabb.max_bound += glm::vec3(fat_margin);
+        insert_leaf(leaf);
+        return true;
+    }
+
+    void AABBTree::clear() {
+        this->m_nodes.clear();
+        this->m_leaves.clear();
+        this->m_root = null_node;
+        this->m_free_list = null_node;
+    }
+
+    bool AABBTree::contains(const uint32_t body) const {
+        return body < this->m_leaves.size() && this->m_leaves[body] != null_node;
+    }
+
+    int AABBTree::height() const {
+        return this->m_root == null_node ? 0 : this->m_nodes[this->m_root].height;
+    }
+
+    void AABBTree::find_pairs(
+        const std::vector<AABB>& aabbs, const std::vector<uint32_t>& awake_bodies,
+        const std::vector<uint8_t>& is_awake, const std::vector<uint16_t>& masks,
+        const std::vector<uint16_t>& filters, std::vector<AABBPair>& out_pairs
+        ) {
+        constexpr std::size_t grain = 64;
+        const auto num_ranges = (awake_bodies.size() + grain - 1) / grain;
+        if (this->m_range_pairs.size() < num_ranges) { this->m_range_pairs.resize(num_ranges); }
+
+        // only awake bodies query the tree, a pair of two awake bodies is kept by its lower index
+        Core::JobSystem::Get().ParallelFor(
+            awake_bodies.size(), grain, [&](const std::size_t begin, const std::size_t end) {
+                auto& pairs = this->m_range_pairs[begin / grain];
+                pairs.clear();
+                for (auto k = begin; k < end; ++k) {
+                    const auto i = awake_bodies[k];
+                    if (!contains(i)) { continue; }
+                    const auto filter = filters[i];
+                    query(aabbs[i], [&](const uint32_t j) {
+                        if ((!is_awake[j] || j > i) && (filter & masks[j]) != 0 && aabbs[i].intersect(aabbs[j])) {
+                            pairs.push_back({Math::min(i, j), Math::max(i, j)});
+                        }
+                    });
+                }
+            });
+
+        // ranges are gathered in order, the pairs come out the same as a serial query
+        out_pairs.clear();
+        for (std::size_t r = 0; r < num_ranges; ++r) {
+            out_pairs.insert(out_pairs.end(), this->m_range_pairs[r].begin(), this->m_range_pairs[r].end());
+        }
+    }
+
+} // namespace Physics
@@ -0,0 +1,145 @@
+﻿#pragma once
+#include <vector>
+
+#include "broadphase.h"
+#include "physicsmesh.h"
+#include "ray.h"
+
+
+namespace Physics {
+
+    // dynamic bounding volume tree over the collider aabbs, leaves store fattened
+    // boxes so bodies that barely move don't have to be reinserted every step
+    struct AABBTree {
+        static constexpr auto null_node = 0xFFFFFFFFu;
+        static constexpr auto fat_margin = 0.1f;
+        static constexpr auto max_stack = 64;
+
+        struct Node {
+            AABB aabb;
+            uint32_t parent = null_node;
+            uint32_t left = null_node; // next free node while on the free list
+            uint32_t right = null_node;
+            uint32_t body = null_node;
+            int32_t height = 0;
+
+            [[nodiscard]] bool leaf() const { return this->right == null_node; }
+        };
+
+    private:
+        std::vector<Node> m_nodes;
+        std::vector<uint32_t> m_leaves; // body -> leaf node
+        uint32_t m_root = null_node;
+        uint32_t m_free_list = null_node;
+        // pairs found by every range of awake bodies, concatenated in range order after the parallel query
+        std::vector<std::vector<AABBPair>> m_range_pairs;
+
+        uint32_t allocate_node();
+        void free_node(uint32_t node);
+        void insert_leaf(uint32_t leaf);
+        void remove_leaf(uint32_t leaf);
+        void refit_upwards(uint32_t node);
+        uint32_t balance(uint32_t node);
+
+    public:
+        void insert(uint32_t body, const AABB& aabb);
+        void remove(uint32_t body);
+        // removes body and hands the leaf of last over to it, last is the collider that took the place
+        // of body in the collider arrays
+        void remove_body(uint32_t body, uint32_t last);
+        // reinserts the body if its aabb left the fattened leaf box, returns true if the tree changed
+        bool update(uint32_t body, const AABB& aabb);
+        void clear();
+
+        [[nodiscard]] bool contains(uint32_t body) const;
+        [[nodiscard]] int height() const;
+
+        // all pairs with at least one awake body whose tight aabbs overlap and whose layers collide,
+        // every pair is reported once
+        void find_pairs(
+            const std::vector<AABB>& aabbs, const std::vector<uint32_t>& awake_bodies,
+            const std::vector<uint8_t>& is_awake, const std::vector<uint16_t>& masks,
+            const std::vector<uint16_t>& filters, std::vector<AABBPair>& out_pairs
+            );
+
+        template <typename F>
+        void query(const AABB& aabb, F&& callback) const;
+        template <typename F>
+        void cast_ray(const Ray& ray, F&& callback) const;
+    };
+
+    namespace Internal {
+
+        // node stack of a tree walk. the rotations in balance don't strictly bound the height, so past
+        // max_stack entries it spills to the heap instead of overflowing, a balanced tree never gets there
+        struct NodeStack {
+            uint32_t fixed[AABBTree::max_stack];
+            uint32_t size = 0;
+            std::vector<uint32_t> spilled;
+
+            void push(const uint32_t node) {
+                if (this->size < AABBTree::max_stack) {
+                    this->fixed[this->size++] = node;
+                }
+                else {
+                    this->spilled.push_back(node);
+                }
+            }
+
+            // the spilled nodes were all pushed after the fixed ones
+            uint32_t pop() {
+                if (!this->spilled.empty()) {
+                    const auto node = this->spilled.back();
+                    this->spilled.pop_back();
+                    return node;
+                }
+                return this->fixed[--this->size];
+            }
+
+            [[nodiscard]] bool empty() const { return this->size == 0 && this->spilled.empty(); }
+        };
+
+    }
+
+    template <typename F>
+    void AABBTree::query(const AABB& aabb, F&& callback) const {
+        if (this->m_root == null_node) { return; }
+
+        Internal::NodeStack stack;
+        stack.push(this->m_root);
+        while (!stack.empty()) {
+            const auto& node = this->m_nodes[stack.pop()];
+            if (!node.aabb.intersect(aabb)) { continue; }
+            if (node.leaf()) {
+                callback(node.body);
+            }
+            else {
+                stack.push(node.left);
+                stack.push(node.right);
+            }
+        }
+    }
+
+    template <typename F>
+    void AABBTree::cast_ray(const Ray& ray, F&& callback) const {
+        if (this->m_root == null_node) { return; }
+
+        Internal::NodeStack stack;
+        stack.push(this->m_root);
+        while (!stack.empty()) {
+            const auto& node = this->m_nodes[stack.pop()];
+            if (HitInfo hit;
+                !node.aabb.intersect(ray, hit) || (ray.length != inf_f && hit.t > ray.length)) {
+                continue;
+            }
+            if (node.leaf()) {
+                callback(node.body);
+            }
+            else {
+                stack.push(node.left);
+                stack.push(node.right);
+            }
+        }
+    }
+
+} // namespace Physics
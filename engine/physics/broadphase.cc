@@ -0,0 +1,238 @@
+﻿#include "config.h"
+#include "broadphase.h"
+
+#include <algorithm>
+
+#include "physicsmesh.h"
+#include "core/maths.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        inline uint64_t pair_key(const uint32_t a, const uint32_t b) {
+            return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+        }
+
+        // on ties min endpoints go first so that touching boxes count as overlapping
+        template <typename Endpoint>
+        bool less(const Endpoint& lhs, const Endpoint& rhs) {
+            return lhs.value < rhs.value || (lhs.value == rhs.value && !lhs.is_max && rhs.is_max);
+        }
+
+        // the body breaks the remaining ties so that a rebuild doesn't depend on the sort implementation
+        template <typename Endpoint>
+        bool rebuild_less(const Endpoint& lhs, const Endpoint& rhs) {
+            return less(lhs, rhs) || (!less(rhs, lhs) && lhs.body < rhs.body);
+        }
+
+    }
+
+    void SweepAndPrune::add_pair(const uint32_t a, const uint32_t b) {
+        const auto [it, inserted] = this->m_pair_index.try_emplace(
+            Internal::pair_key(a, b), static_cast<uint32_t>(this->m_pairs.size())
+            );
+        if (inserted) {
+            this->m_pairs.push_back({Math::min(a, b), Math::max(a, b)});
+        }
+    }
+
+    void SweepAndPrune::remove_pair(const uint32_t a, const uint32_t b) {
+        const auto it = this->m_pair_index.find(Internal::pair_key(a, b));
+        if (it == this->m_pair_index.end()) { return; }
+
+        const auto idx = it->second;
+        this->m_pair_index.erase(it);
+        if (idx + 1 != this->m_pairs.size()) {
+            const auto& last = this->m_pairs.back();
+            this->m_pairs[idx] = last;
+            this->m_pair_index[Internal::pair_key(last.a, last.b)] = idx;
+        }
+        this->m_pairs.pop_back();
+    }
+
+    // sorts every axis from scratch and finds the overlapping pairs with a single sweep along x,
+    // static bodies are only ever tested against the dynamic ones
+    void SweepAndPrune::rebuild(
+        const std::vector<AABB>& aabbs, const std::vector<uint32_t>& dynamic_bodies,
+        const std::vector<uint32_t>& static_bodies, const std::vector<uint16_t>& masks,
+        const std::vector<uint16_t>& filters
+        ) {
+        this->m_pairs.clear();
+        this->m_pair_index.clear();
+        for (auto axis = 0; axis < 3; ++axis) {
+            auto& endpoints = this->m_endpoints[axis];
+            auto& statics = this->m_static_endpoints[axis];
+            endpoints.clear();
+            statics.clear();
+            for (const auto i : dynamic_bodies) {
+                endpoints.push_back({aabbs[i].min_bound[axis], i, 0, 0});
+                endpoints.push_back({aabbs[i].max_bound[axis], i, 1, 0});
+            }
+            for (const auto i : static_bodies) {
+                statics.push_back({aabbs[i].min_bound[axis], i, 0, 0});
+                statics.push_back({aabbs[i].max_bound[axis], i, 1, 0});
+            }
+            std::ranges::sort(endpoints, Internal::rebuild_less<Endpoint>);
+            std::ranges::sort(statics, Internal::rebuild_less<Endpoint>);
+            for (auto& e : endpoints) {
+                const auto below = std::ranges::partition_point(statics, [&e](const Endpoint& s) { return Internal::less(s, e); });
+                e.cursor = static_cast<uint32_t>(below - statics.begin());
+            }
+        }
+
+        const auto try_add = [&](const uint32_t a, const uint32_t b) {
+            if ((filters[a] & masks[b]) != 0 && aabbs[a].intersect(aabbs[b])) { add_pair(a, b); }
+        };
+        const auto& endpoints = this->m_endpoints[0];
+        const auto& statics = this->m_static_endpoints[0];
+        std::vector<uint32_t> open_dynamic;
+        std::vector<uint32_t> open_static;
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while (i < endpoints.size() || j < statics.size()) {
+            const auto is_static = i == endpoints.size() || (j < statics.size() && Internal::less(statics[j], endpoints[i]));
+            const auto& e = is_static ? statics[j++] : endpoints[i++];
+            auto& open = is_static ? open_static : open_dynamic;
+            if (e.is_max) {
+                std::erase(open, e.body);
+                continue;
+            }
+            for (const auto other : open_dynamic) { try_add(e.body, other); }
+            if (!is_static) {
+                for (const auto other : open_static) { try_add(e.body, other); }
+            }
+            open.push_back(e.body);
+        }
+
+        this->m_num_bodies = static_cast<uint32_t>(aabbs.size());
+        this->m_num_static = static_cast<uint32_t>(static_bodies.size());
+    }
+
+    void SweepAndPrune::sort_axis(
+        const int axis, const std::vector<AABB>& aabbs, const std::vector<uint16_t>& masks,
+        const std::vector<uint16_t>& filters
+        ) {
+        auto& endpoints = this->m_endpoints[axis];
+        for (auto& e : endpoints) {
+            e.value = e.is_max ? aabbs[e.body].max_bound[axis] : aabbs[e.body].min_bound[axis];
+        }
+
+        // insertion sort, every swap between a min and a max endpoint is the only
+        // place where the overlap state of a pair can change
+        for (std::size_t i = 1; i < endpoints.size(); ++i) {
+            const auto e = endpoints[i];
+            auto j = i;
+            for (; j > 0 && Internal::less(e, endpoints[j - 1]); --j) {
+                const auto& other = endpoints[j - 1];
+                // a filtered pair is never added so it doesn't need removing either
+                if (e.body != other.body && (filters[e.body] & masks[other.body]) != 0) {
+                    if (!e.is_max && other.is_max) {
+                        if (aabbs[e.body].intersect(aabbs[other.body])) { add_pair(e.body, other.body); }
+                    }
+                    else if (e.is_max && !other.is_max) {
+                        remove_pair(e.body, other.body);
+                    }
+                }
+                endpoints[j] = other;
+            }
+            endpoints[j] = e;
+        }
+
+        // the static endpoints stay where they are, a dynamic endpoint passing one of them is
+        // the same swap the insertion sort would have made in a single list
+        const auto& statics = this->m_static_endpoints[axis];
+        for (auto& e : endpoints) {
+            for (; e.cursor < statics.size() && Internal::less(statics[e.cursor], e); ++e.cursor) {
+                const auto& s = statics[e.cursor];
+                if ((filters[e.body] & masks[s.body]) == 0) { continue; }
+                if (e.is_max && !s.is_max) {
+                    if (aabbs[e.body].intersect(aabbs[s.body])) { add_pair(e.body, s.body); }
+                }
+                else if (!e.is_max && s.is_max) {
+                    remove_pair(e.body, s.body);
+                }
+            }
+            for (; e.cursor > 0 && Internal::less(e, statics[e.cursor - 1]); --e.cursor) {
+                const auto& s = statics[e.cursor - 1];
+                if ((filters[e.body] & masks[s.body]) == 0) { continue; }
+                if (!e.is_max && s.is_max) {
+                    if (aabbs[e.body].intersect(aabbs[s.body])) { add_pair(e.body, s.body); }
+                }
+                else if (e.is_max && !s.is_max) {
+                    remove_pair(e.body, s.body);
+                }
+            }
+        }
+    }
+
+    void SweepAndPrune::update(
+        const std::vector<AABB>& aabbs, const std::vector<uint32_t>& dynamic_bodies,
+        const std::vector<uint32_t>& static_bodies, const std::vector<uint16_t>& masks,
+        const std::vector<uint16_t>& filters
+        ) {
+        // a destroyed static body clears the sweep, so a different count means new static bodies
+        if (this->m_num_bodies == 0 || this->m_num_static != static_bodies.size()) {
+            this->rebuild(aabbs, dynamic_bodies, static_bodies, masks, filters);
+            return;
+        }
+
+        // the rest of the new bodies are dynamic, they are appended past the end of every axis,
+        // which is a valid non overlapping state that the sort then moves into place
+        for (; this->m_num_bodies < aabbs.size(); ++this->m_num_bodies) {
+            for (auto axis = 0; axis < 3; ++axis) {
+                const auto above = static_cast<uint32_t>(this->m_static_endpoints[axis].size());
+                this->m_endpoints[axis].push_back({max_f, this->m_num_bodies, 0, above});
+                this->m_endpoints[axis].push_back({max_f, this->m_num_bodies, 1, above});
+            }
+        }
+
+        for (auto axis = 0; axis < 3; ++axis) {
+            sort_axis(axis, aabbs, masks, filters);
+        }
+    }
+
+    void SweepAndPrune::remove_body(const uint32_t body, const uint32_t last) {
+        // bodies created since the last update have no endpoints yet
+        if (body >= this->m_num_bodies) { return; }
+
+        // the static lists would need new cursors for every dynamic endpoint, and an untracked last
+        // might be static, both are left to the rebuild on the next update
+        const auto& statics = this->m_static_endpoints[0];
+        if (last >= this->m_num_bodies ||
+            std::ranges::any_of(statics, [body](const Endpoint& e) { return e.body == body; })) {
+            this->clear();
+            return;
+        }
+
+        std::vector<AABBPair> pairs;
+        pairs.swap(this->m_pairs);
+        this->m_pair_index.clear();
+        for (const auto& p : pairs) {
+            const auto a = p.a == last ? body : p.a;
+            const auto b = p.b == last ? body : p.b;
+            if (p.a != body && p.b != body) { add_pair(a, b); }
+        }
+
+        for (auto axis = 0; axis < 3; ++axis) {
+            std::erase_if(this->m_endpoints[axis], [body](const Endpoint& e) { return e.body == body; });
+            for (auto* endpoints : {&this->m_endpoints[axis], &this->m_static_endpoints[axis]}) {
+                for (auto& e : *endpoints) {
+                    if (e.body == last) { e.body = body; }
+                }
+            }
+        }
+        --this->m_num_bodies;
+    }
+
+    void SweepAndPrune::clear() {
+        for (auto& endpoints : this->m_endpoints) { endpoints.clear(); }
+        for (auto& endpoints : this->m_static_endpoints) { endpoints.clear(); }
+        this->m_pairs.clear();
+        this->m_pair_index.clear();
+        this->m_num_bodies = 0;
+        this->m_num_static = 0;
+    }
+
+} // namespace Physics
@@ -0,0 +1,67 @@
+﻿#pragma once
+#include <unordered_map>
+#include <vector>
+
+#include "physicsresource.h"
+
+
+namespace Physics {
+
+    struct AABB;
+
+    // collider indices of two bodies whose boxes overlap, a is the lower one
+    struct AABBPair {
+        uint32_t a, b;
+    };
+
+    // sweep and prune over all three axes, the endpoint lists are kept sorted between
+    // steps so that a step only pays for the endpoints that actually moved past each other.
+    // static bodies live in their own lists that a step never touches, every dynamic endpoint
+    // remembers how many static endpoints lie below it and walks that count when it moves
+    struct SweepAndPrune {
+    private:
+        struct Endpoint {
+            float value;
+            uint32_t body: 31;
+            uint32_t is_max: 1;
+            // static endpoints below this one, only used for dynamic endpoints
+            uint32_t cursor;
+        };
+
+        std::vector<Endpoint> m_endpoints[3];
+        std::vector<Endpoint> m_static_endpoints[3];
+        std::vector<AABBPair> m_pairs;
+        std::unordered_map<uint64_t, uint32_t> m_pair_index;
+        uint32_t m_num_bodies = 0;
+        uint32_t m_num_static = 0;
+
+        void add_pair(uint32_t a, uint32_t b);
+        void remove_pair(uint32_t a, uint32_t b);
+        void rebuild(
+            const std::vector<AABB>& aabbs, const std::vector<uint32_t>& dynamic_bodies,
+            const std::vector<uint32_t>& static_bodies, const std::vector<uint16_t>& masks,
+            const std::vector<uint16_t>& filters
+            );
+        void sort_axis(
+            int axis, const std::vector<AABB>& aabbs, const std::vector<uint16_t>& masks,
+            const std::vector<uint16_t>& filters
+            );
+
+    public:
+        // pairs of two static bodies are never reported, nor pairs whose layers don't collide,
+        // filters holds the layers every body collides with. the static lists are only rebuilt
+        // when static_bodies changes size or after clear, so a static body that moves needs a clear
+        void update(
+            const std::vector<AABB>& aabbs, const std::vector<uint32_t>& dynamic_bodies,
+            const std::vector<uint32_t>& static_bodies, const std::vector<uint16_t>& masks,
+            const std::vector<uint16_t>& filters
+            );
+        // drops body and renames last to body, last is the collider that took the place of body in the
+        // collider arrays
+        void remove_body(uint32_t body, uint32_t last);
+        void clear();
+
+        [[nodiscard]] const std::vector<AABBPair>& pairs() const { return this->m_pairs; }
+    };
+
+} // namespace Physics
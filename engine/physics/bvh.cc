@@ -0,0 +1,352 @@
+﻿#include "config.h"
+#include "bvh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+
+#include "physicsmesh.h"
+#include "ray.h"
+#include "core/maths.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        struct BuildTri {
+            AABB bounds;
+            glm::vec3 centroid;
+            BVH4::TriRef ref;
+        };
+
+        struct BuildNode {
+            AABB bounds;
+            uint32_t left = 0, right = 0;
+            uint32_t first = 0, count = 0;
+
+            [[nodiscard]] bool leaf() const { return this->count > 0; }
+        };
+
+        uint32_t build_binary(
+            std::vector<BuildNode>& nodes, std::vector<BuildTri>& tris, const uint32_t first, const uint32_t count
+            ) {
+            constexpr auto num_bins = 12;
+
+            const auto node_idx = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+
+            AABB bounds, centroid_bounds;
+            for (uint32_t i = first; i < first + count; ++i) {
+                bounds.grow(tris[i].bounds);
+                centroid_bounds.grow(tris[i].centroid);
+            }
+            nodes[node_idx].bounds = bounds;
+
+            if (count <= BVH4::max_leaf_tris) {
+                nodes[node_idx].first = first;
+                nodes[node_idx].count = count;
+                return node_idx;
+            }
+
+            const auto extent = centroid_bounds.max_bound - centroid_bounds.min_bound;
+            auto axis = 0;
+            if (extent.y > extent[axis]) axis = 1;
+            if (extent.z > extent[axis]) axis = 2;
+
+            auto mid = first + count / 2;
+            if (extent[axis] > 0.0f) {
+                struct Bin {
+                    AABB bounds;
+                    uint32_t count = 0;
+                } bins[num_bins];
+
+                const auto scale = static_cast<float>(num_bins) / extent[axis];
+                const auto bin_of = [&](const BuildTri& t) {
+                    const auto b = static_cast<int>((t.centroid[axis] - centroid_bounds.min_bound[axis]) * scale);
+                    return Math::min(b, num_bins - 1);
+                };
+                for (uint32_t i = first; i < first + count; ++i) {
+                    auto& bin = bins[bin_of(tris[i])];
+                    bin.bounds.grow(tris[i].bounds);
+                    ++bin.count;
+                }
+
+                // sweep from the right to get the cost of every split plane in two passes
+                float right_cost[num_bins - 1];
+                AABB acc;
+                uint32_t acc_count = 0;
+                for (auto i = num_bins - 1; i > 0; --i) {
+                    acc.grow(bins[i].bounds);
+                    acc_count += bins[i].count;
+                    right_cost[i - 1] = acc_count > 0 ? acc.area() * static_cast<float>(acc_count) : 0.0f;
+                }
+
+                auto best_split = -1;
+                auto best_cost = max_f;
+                acc = AABB();
+                acc_count = 0;
+                for (auto i = 0; i < num_bins - 1; ++i) {
+                    acc.grow(bins[i].bounds);
+                    acc_count += bins[i].count;
+                    const auto cost = (acc_count > 0 ? acc.area() * static_cast<float>(acc_count) : 0.0f) +
+                        right_cost[i];
+                    if (acc_count > 0 && acc_count < count && cost < best_cost) {
+                        best_cost = cost;
+                        best_split = i;
+                    }
+                }
+
+                if (best_split >= 0) {
+                    const auto it = std::partition(
+                        tris.begin() + first, tris.begin() + first + count,
+                        [&](const BuildTri& t) { return bin_of(t) <= best_split; }
+                        );
+                    mid = static_cast<uint32_t>(it - tris.begin());
+                }
+            }
+
+            // all centroids in one bin, fall back to a median split
+            if (mid == first || mid == first + count) {
+                mid = first + count / 2;
+                std::nth_element(
+                    tris.begin() + first, tris.begin() + mid, tris.begin() + first + count,
+                    [&](const BuildTri& a, const BuildTri& b) { return a.centroid[axis] < b.centroid[axis]; }
+                    );
+            }
+
+            const auto left = build_binary(nodes, tris, first, mid - first);
+            const auto right = build_binary(nodes, tris, mid, first + count - mid);
+            nodes[node_idx].left = left;
+            nodes[node_idx].right = right;
+            return node_idx;
+        }
+
+        void quantize(BVH4::Node& node, const AABB* child_bounds, const int num_children) {
+            AABB parent;
+            for (auto i = 0; i < num_children; ++i) { parent.grow(child_bounds[i]); }
+
+            node.origin = parent.min_bound;
+            for (auto axis = 0; axis < 3; ++axis) {
+                const auto extent = parent.max_bound[axis] - parent.min_bound[axis];
+                auto e = extent > 0.0f ? static_cast<int>(std::ceil(std::log2(extent / 255.0f))) : -126;
+                e = Math::max(e, -126);
+                while (node.origin[axis] + 255.0f * std::ldexp(1.0f, e) < parent.max_bound[axis]) { ++e; }
+                node.exponent[axis] = static_cast<int8_t>(e);
+
+                const auto step = std::ldexp(1.0f, e);
+                for (auto i = 0; i < num_children; ++i) {
+                    const auto lo = child_bounds[i].min_bound[axis];
+                    const auto hi = child_bounds[i].max_bound[axis];
+                    auto qlo = static_cast<int>(std::floor((lo - node.origin[axis]) / step));
+                    auto qhi = static_cast<int>(std::ceil((hi - node.origin[axis]) / step));
+                    qlo = Math::max(0, Math::min(qlo, 255));
+                    qhi = Math::max(0, Math::min(qhi, 255));
+                    // round outwards so that the dequantized box is always conservative
+                    while (qlo > 0 && node.origin[axis] + static_cast<float>(qlo) * step > lo) { --qlo; }
+                    while (qhi < 255 && node.origin[axis] + static_cast<float>(qhi) * step < hi) { ++qhi; }
+                    node.qmin[axis][i] = static_cast<uint8_t>(qlo);
+                    node.qmax[axis][i] = static_cast<uint8_t>(qhi);
+                }
+            }
+        }
+
+        uint32_t collapse(const std::vector<BuildNode>& bnodes, const uint32_t b, BVH4& out) {
+            const auto node_idx = static_cast<uint32_t>(out.nodes.size());
+            out.nodes.emplace_back();
+
+            uint32_t kids[4];
+            auto num_kids = 0;
+            if (bnodes[b].leaf()) {
+                kids[num_kids++] = b;
+            }
+            else {
+                kids[num_kids++] = bnodes[b].left;
+                kids[num_kids++] = bnodes[b].right;
+            }
+
+            // open up the largest inner child until the node is full
+            while (num_kids < 4) {
+                auto best = -1;
+                auto best_area = -1.0f;
+                for (auto i = 0; i < num_kids; ++i) {
+                    if (const auto& k = bnodes[kids[i]];
+                        !k.leaf() && k.bounds.area() > best_area) {
+                        best_area = k.bounds.area();
+                        best = i;
+                    }
+                }
+                if (best < 0) { break; }
+                const auto opened = kids[best];
+                kids[best] = bnodes[opened].left;
+                kids[num_kids++] = bnodes[opened].right;
+            }
+
+            BVH4::Node node{};
+            AABB child_bounds[4];
+            for (auto i = 0; i < num_kids; ++i) { child_bounds[i] = bnodes[kids[i]].bounds; }
+            quantize(node, child_bounds, num_kids);
+
+            for (auto i = 0; i < num_kids; ++i) {
+                const auto& k = bnodes[kids[i]];
+                node.child_mask |= static_cast<uint8_t>(1 << i);
+                if (k.leaf()) {
+                    node.tri_count[i] = static_cast<uint8_t>(k.count);
+                    node.child[i] = k.first;
+                }
+                else {
+                    node.child[i] = collapse(bnodes, kids[i], out);
+                }
+            }
+
+            out.nodes[node_idx] = node;
+            return node_idx;
+        }
+
+        inline __m128 dequantize(const uint8_t q[4]) {
+            int32_t bits;
+            std::memcpy(&bits, q, sizeof(bits));
+            const auto zero = _mm_setzero_si128();
+            auto v = _mm_cvtsi32_si128(bits);
+            v = _mm_unpacklo_epi8(v, zero);
+            v = _mm_unpacklo_epi16(v, zero);
+            return _mm_cvtepi32_ps(v);
+        }
+
+        struct TraversalEntry {
+            uint32_t child;
+            uint32_t tri_count;
+            float t;
+        };
+
+        // the build has no depth limit, so a degenerate mesh can need more than the fixed part
+        struct TraversalStack {
+            static constexpr auto max_fixed = 256;
+            TraversalEntry fixed[max_fixed];
+            int size = 0;
+            std::vector<TraversalEntry> spilled;
+
+            void push(const TraversalEntry& e) {
+                if (this->size < max_fixed) {
+                    this->fixed[this->size++] = e;
+                }
+                else {
+                    this->spilled.push_back(e);
+                }
+            }
+
+            // the spilled entries were all pushed after the fixed ones
+            TraversalEntry pop() {
+                if (!this->spilled.empty()) {
+                    const auto e = this->spilled.back();
+                    this->spilled.pop_back();
+                    return e;
+                }
+                return this->fixed[--this->size];
+            }
+
+            [[nodiscard]] bool empty() const { return this->size == 0 && this->spilled.empty(); }
+        };
+
+    }
+
+    void BVH4::build(const ColliderMesh& mesh) {
+        this->nodes.clear();
+        this->tris.clear();
+
+        std::vector<Internal::BuildTri> build_tris;
+        for (uint32_t p = 0; p < mesh.primitives.size(); ++p) {
+            const auto& triangles = mesh.primitives[p].triangles;
+            for (uint32_t t = 0; t < triangles.size(); ++t) {
+                Internal::BuildTri bt;
+                bt.bounds.grow(triangles[t].v0);
+                bt.bounds.grow(triangles[t].v1);
+                bt.bounds.grow(triangles[t].v2);
+                bt.centroid = 0.5f * (bt.bounds.min_bound + bt.bounds.max_bound);
+                bt.ref = {p, t};
+                build_tris.emplace_back(bt);
+            }
+        }
+        if (build_tris.empty()) { return; }
+
+        std::vector<Internal::BuildNode> bnodes;
+        bnodes.reserve(2 * build_tris.size() / max_leaf_tris + 1);
+        Internal::build_binary(bnodes, build_tris, 0, static_cast<uint32_t>(build_tris.size()));
+
+        this->tris.reserve(build_tris.size());
+        for (const auto& bt : build_tris) { this->tris.emplace_back(bt.ref); }
+
+        Internal::collapse(bnodes, 0, *this);
+        this->nodes.shrink_to_fit();
+    }
+
+    bool BVH4::intersect(const ColliderMesh& mesh, const Ray& r, HitInfo& hit) const {
+        if (this->nodes.empty()) { return false; }
+
+        constexpr auto max_inv = 1e30f;
+        glm::vec3 inv_dir;
+        for (auto i = 0; i < 3; ++i) {
+            inv_dir[i] = std::isfinite(r.inv_dir[i]) ? r.inv_dir[i] : std::copysign(max_inv, r.inv_dir[i]);
+        }
+
+        Internal::TraversalStack stack;
+        stack.push({0, 0, 0.0f});
+
+        const auto zero = _mm_setzero_ps();
+        auto found = false;
+        while (!stack.empty()) {
+            const auto e = stack.pop();
+            if (e.t > hit.t) { continue; }
+
+            if (e.tri_count > 0) {
+                for (uint32_t i = e.child; i < e.child + e.tri_count; ++i) {
+                    const auto [prim, tri] = this->tris[i];
+                    if (HitInfo temp_hit;
+                        mesh.primitives[prim].triangles[tri].intersect(r, temp_hit) && temp_hit.t < hit.t) {
+                        hit = temp_hit;
+                        hit.prim_n = prim;
+                        hit.tri_n = tri;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+
+            const auto& node = this->nodes[e.child];
+            auto tnear = zero;
+            auto tfar = _mm_set1_ps(hit.t);
+            for (auto axis = 0; axis < 3; ++axis) {
+                const auto step = std::ldexp(1.0f, node.exponent[axis]);
+                const auto scale = _mm_set1_ps(step * inv_dir[axis]);
+                const auto offset = _mm_set1_ps((node.origin[axis] - r.orig[axis]) * inv_dir[axis]);
+                const auto t0 = _mm_add_ps(_mm_mul_ps(Internal::dequantize(node.qmin[axis]), scale), offset);
+                const auto t1 = _mm_add_ps(_mm_mul_ps(Internal::dequantize(node.qmax[axis]), scale), offset);
+                tnear = _mm_max_ps(tnear, _mm_min_ps(t0, t1));
+                tfar = _mm_min_ps(tfar, _mm_max_ps(t0, t1));
+            }
+            const auto mask = _mm_movemask_ps(_mm_cmple_ps(tnear, tfar)) & node.child_mask;
+            if (mask == 0) { continue; }
+
+            alignas(16) float t[4];
+            _mm_store_ps(t, tnear);
+
+            // push the farthest child first so the nearest one is visited next
+            Internal::TraversalEntry hits[4];
+            auto num_hits = 0;
+            for (auto i = 0; i < 4; ++i) {
+                if ((mask & (1 << i)) == 0) { continue; }
+                auto j = num_hits++;
+                for (; j > 0 && hits[j - 1].t < t[i]; --j) { hits[j] = hits[j - 1]; }
+                hits[j] = {node.child[i], node.tri_count[i], t[i]};
+            }
+            for (auto i = 0; i < num_hits; ++i) { stack.push(hits[i]); }
+        }
+
+        return found;
+    }
+
+    std::size_t BVH4::size_in_bytes() const {
+        return this->nodes.size() * sizeof(Node) + this->tris.size() * sizeof(TriRef);
+    }
+
+} // namespace Physics
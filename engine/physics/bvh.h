@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <vector>
+
+#include "physicsresource.h"
+#include "vec3.hpp"
+
+
+namespace Physics {
+
+    struct Ray;
+    struct HitInfo;
+    struct ColliderMesh;
+
+    // 4-wide bvh, child bounds are stored as 8-bit offsets from the node origin
+    // so that a whole node (4 children) fits into a single cache line
+    struct BVH4 {
+        static constexpr auto max_leaf_tris = 4;
+
+        struct alignas(64) Node {
+            glm::vec3 origin;
+            int8_t exponent[3];
+            uint8_t child_mask;
+            uint8_t qmin[3][4];
+            uint8_t qmax[3][4];
+            uint8_t tri_count[4]; // 0 for inner nodes
+            uint32_t child[4]; // node index or first triangle ref
+        };
+
+        struct TriRef {
+            uint32_t prim;
+            uint32_t tri;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<TriRef> tris;
+
+        void build(const ColliderMesh& mesh);
+        bool intersect(const ColliderMesh& mesh, const Ray& r, HitInfo& hit) const;
+
+        [[nodiscard]] bool empty() const { return this->nodes.empty(); }
+        [[nodiscard]] std::size_t size_in_bytes() const;
+    };
+
+} // namespace Physics
\ No newline at end of file
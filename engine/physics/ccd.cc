@@ -0,0 +1,123 @@
+﻿#include "config.h"
+#include "ccd.h"
+
+#include "core/maths.h"
+#include "physics/broadphase.h"
+#include "physics/phy.h"
+#include "physics/physicsmesh.h"
+#include "physics/simplex.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        float thickness(const World& world, const uint32_t i) {
+            const auto& colliders = world.get_colliders();
+            const auto& aabb = world.get_collider_meshes().simple[colliders.meshes[i].index];
+            const auto extent = (aabb.max_bound - aabb.min_bound) * glm::abs(colliders.states[i].scale);
+            return Math::min(extent.x, extent.y, extent.z);
+        }
+
+    }
+
+    void ContinuousCollision::sweep(World& world, const std::vector<uint32_t>& bodies, const float dt) {
+        auto& colliders = world.colliders();
+        for (const auto i : this->m_fast_bodies) {
+            this->m_fast[i] = 0;
+        }
+        this->m_fast_bodies.clear();
+        this->m_fast.resize(colliders.aabbs.size(), 0);
+
+        for (const auto i : bodies) {
+            const auto motion = colliders.dynamics.vel[i] * dt;
+            const auto half_thickness = 0.5f * Internal::thickness(world, i);
+            if (glm::dot(motion, motion) <= half_thickness * half_thickness) { continue; }
+
+            this->m_fast[i] = 1;
+            this->m_fast_bodies.push_back(i);
+            // integrate_motion writes the tight aabb again, the swept one only lives through the broadphase
+            auto& aabb = colliders.aabbs[i];
+            aabb.min_bound += glm::min(motion, glm::vec3(0));
+            aabb.max_bound += glm::max(motion, glm::vec3(0));
+        }
+    }
+
+    // transforms hold the end of the step, a is moved back along the motion relative to b and tested
+    // with the boolean gjk. samples are at most half the thinner shape apart so a thin wall can't fall
+    // between two of them, the first overlapping sample is then bisected down to the tolerance.
+    // the rotation is left at its end of step value, tunnelling comes from the linear motion
+    float ContinuousCollision::time_of_impact(World& world, const uint32_t a, const uint32_t b, const float dt) const {
+        auto& colliders = world.colliders();
+        const auto& dyn = colliders.dynamics;
+        const auto motion = (dyn.vel[a] - dyn.vel[b]) * dt;
+        const auto length = glm::length(motion);
+        const auto step = 0.5f * Math::min(Internal::thickness(world, a), Internal::thickness(world, b));
+        if (length <= step) { return 1.0f; }
+
+        const auto end_a = colliders.transforms[a];
+        SupportHint hint;
+        auto axis = glm::vec3(0);
+        const auto overlaps = [&](const float t) {
+            colliders.transforms[a] = glm::translate((t - 1.0f) * motion) * end_a;
+            return world.overlap(a, b, hint, axis);
+        };
+
+        auto toi = 1.0f;
+        // touching at the start is a discrete contact, the solver already took care of it
+        if (!overlaps(0.0f)) {
+            const auto num_samples = Math::min(static_cast<int>(std::ceil(length / step)), max_samples);
+            for (auto s = 1; s <= num_samples; ++s) {
+                const auto t = static_cast<float>(s) / static_cast<float>(num_samples);
+                if (!overlaps(t)) { continue; }
+
+                auto lo = static_cast<float>(s - 1) / static_cast<float>(num_samples);
+                auto hi = t;
+                for (auto i = 0; i < max_bisections && (hi - lo) * length > tolerance; ++i) {
+                    const auto mid = 0.5f * (lo + hi);
+                    (overlaps(mid) ? hi : lo) = mid;
+                }
+                toi = hi;
+                break;
+            }
+        }
+        colliders.transforms[a] = end_a;
+        return toi;
+    }
+
+    void ContinuousCollision::clamp(World& world, const std::vector<AABBPair>& pairs, const float dt) {
+        if (this->m_fast_bodies.empty()) { return; }
+
+        auto& colliders = world.colliders();
+        const auto& mesh_aabbs = world.get_collider_meshes().simple;
+
+        this->m_toi.resize(colliders.aabbs.size(), 1.0f);
+        this->m_clamped.clear();
+        const auto lower = [this](const uint32_t i, const float toi) {
+            if (toi >= this->m_toi[i]) { return; }
+            if (this->m_toi[i] == 1.0f) { this->m_clamped.push_back(i); }
+            this->m_toi[i] = toi;
+        };
+
+        for (const auto& [a, b] : pairs) {
+            if (!this->m_fast[a] && !this->m_fast[b]) { continue; }
+            const auto toi = this->time_of_impact(world, a, b, dt);
+            if (toi < 1.0f) {
+                lower(a, toi);
+                lower(b, toi);
+            }
+        }
+
+        auto& dyn = colliders.dynamics;
+        // bodies without mass keep the path they were given, the others are pulled back
+        for (const auto i : this->m_clamped) {
+            if (colliders.states[i].inv_mass > 0.0f) {
+                dyn.pos[i] -= dyn.vel[i] * dt * (1.0f - this->m_toi[i]);
+                colliders.transforms[i] = glm::translate(dyn.pos[i]) * glm::mat4_cast(dyn.rot[i]) * glm::scale(colliders.states[i].scale);
+                colliders.aabbs[i] = rotate_aabb_affine(mesh_aabbs[colliders.meshes[i].index], colliders.transforms[i]);
+            }
+            this->m_toi[i] = 1.0f;
+        }
+    }
+
+} // namespace Physics
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <vector>
+
+#include "physicsresource.h"
+
+
+namespace Physics {
+
+    struct AABBPair;
+    struct World;
+
+    namespace Internal {
+        // smallest extent of the shape, a motion shorter than half of it can't skip past another shape
+        float thickness(const World& world, uint32_t i);
+    }
+
+    // continuous collision for bodies that move more than half their thickness in a step, discrete
+    // contacts alone would let them pass through thin walls between two steps.
+    // the aabb of a fast body is swept over its whole motion before the broadphase, and after the
+    // motion is integrated every pair with a fast body is searched for the first time its shapes
+    // touch along the linear relative motion. both bodies are pulled back to that time, slightly
+    // overlapping, so the next step finds the contact and the solver stops them
+    struct ContinuousCollision {
+        // most gjk tests along one motion, past that the samples are further apart than half the
+        // thinner body and thin pairs can be missed again
+        static constexpr auto max_samples = 64;
+        static constexpr auto max_bisections = 16;
+        // overlap the bodies are left with along their relative motion at the time of impact
+        static constexpr auto tolerance = 0.01f;
+
+    private:
+        std::vector<uint8_t> m_fast;
+        std::vector<uint32_t> m_fast_bodies;
+        // fraction of the step every body may keep, indexed by collider index
+        std::vector<float> m_toi;
+        std::vector<uint32_t> m_clamped;
+
+        [[nodiscard]] float time_of_impact(World& world, uint32_t a, uint32_t b, float dt) const;
+
+    public:
+        // flags the fast bodies and grows their aabbs to cover the motion their velocity gives them
+        void sweep(World& world, const std::vector<uint32_t>& bodies, float dt);
+        // runs on the poses integrate_motion left, the bodies that hit something are moved back to
+        // the time of impact and their transforms and aabbs rewritten
+        void clamp(World& world, const std::vector<AABBPair>& pairs, float dt);
+
+        [[nodiscard]] const std::vector<uint32_t>& fast_bodies() const { return this->m_fast_bodies; }
+    };
+
+} // namespace Physics
@@ -0,0 +1,407 @@
+﻿#include "config.h"
+#include "convexhull.h"
+
+#include <algorithm>
+#include <set>
+
+#include "physicsmesh.h"
+#include "core/maths.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        // points closer to a face plane than this, relative to the size of the point set, count as on it
+        constexpr auto hull_tolerance = 1e-5f;
+
+        struct HullFace {
+            uint32_t v[3];
+            glm::vec3 normal;
+            float offset;
+            std::vector<uint32_t> outside;
+            bool alive = true;
+        };
+
+        HullFace make_face(const std::vector<glm::vec3>& points, const uint32_t a, const uint32_t b, const uint32_t c) {
+            HullFace f;
+            f.v[0] = a;
+            f.v[1] = b;
+            f.v[2] = c;
+            const auto n = glm::cross(points[b] - points[a], points[c] - points[a]);
+            const auto len = glm::length(n);
+            f.normal = len > 0.0f ? n / len : glm::vec3(0);
+            f.offset = glm::dot(f.normal, points[a]);
+            return f;
+        }
+
+        uint32_t furthest_from(const std::vector<glm::vec3>& points, const auto& distance) {
+            uint32_t best = 0;
+            auto best_dist = -max_f;
+            for (uint32_t i = 0; i < points.size(); ++i) {
+                if (const auto d = distance(points[i]); d > best_dist) {
+                    best = i;
+                    best_dist = d;
+                }
+            }
+            return best;
+        }
+
+        // quickhull, the outward face planes are handed out as well for measuring depths
+        bool quickhull(
+            const std::vector<glm::vec3>& points, const uint32_t max_vertices, ConvexHull& hull,
+            std::vector<glm::vec4>& planes
+            ) {
+            hull = {};
+            planes.clear();
+            if (points.size() < 4 || max_vertices < 4) { return false; }
+
+            glm::vec3 lo(max_f), hi(-max_f);
+            for (const auto& p : points) {
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+            const auto tolerance = hull_tolerance * glm::length(hi - lo);
+            if (tolerance <= 0.0f) { return false; }
+
+            // initial tetrahedron from the two points furthest apart, the point furthest from their line
+            // and the point furthest from the plane of the three
+            uint32_t extremes[6] = {};
+            for (uint32_t i = 0; i < points.size(); ++i) {
+                for (auto axis = 0; axis < 3; ++axis) {
+                    if (points[i][axis] < points[extremes[2 * axis]][axis]) { extremes[2 * axis] = i; }
+                    if (points[i][axis] > points[extremes[2 * axis + 1]][axis]) { extremes[2 * axis + 1] = i; }
+                }
+            }
+            uint32_t i0 = 0, i1 = 0;
+            auto best = 0.0f;
+            for (const auto a : extremes) {
+                for (const auto b : extremes) {
+                    if (const auto d = glm::length(points[a] - points[b]); d > best) {
+                        best = d;
+                        i0 = a;
+                        i1 = b;
+                    }
+                }
+            }
+            if (best <= tolerance) { return false; }
+
+            const auto p0 = points[i0];
+            const auto line = glm::normalize(points[i1] - p0);
+            const auto i2 = furthest_from(points, [&](const glm::vec3& p) {
+                return glm::length(glm::cross(p - p0, line));
+            });
+            if (glm::length(glm::cross(points[i2] - p0, line)) <= tolerance) { return false; }
+
+            const auto base_normal = glm::normalize(glm::cross(points[i1] - p0, points[i2] - p0));
+            const auto i3 = furthest_from(points, [&](const glm::vec3& p) {
+                return glm::abs(glm::dot(p - p0, base_normal));
+            });
+            if (glm::abs(glm::dot(points[i3] - p0, base_normal)) <= tolerance) { return false; }
+
+            const auto centroid = 0.25f * (points[i0] + points[i1] + points[i2] + points[i3]);
+            std::vector<HullFace> faces;
+            const uint32_t tetra[4][3] = {{i0, i1, i2}, {i0, i1, i3}, {i0, i2, i3}, {i1, i2, i3}};
+            for (const auto& t : tetra) {
+                auto f = make_face(points, t[0], t[1], t[2]);
+                if (glm::dot(f.normal, centroid) > f.offset) { f = make_face(points, t[0], t[2], t[1]); }
+                faces.push_back(std::move(f));
+            }
+
+            std::vector<uint8_t> on_hull(points.size(), 0);
+            on_hull[i0] = on_hull[i1] = on_hull[i2] = on_hull[i3] = 1;
+            const auto assign = [&](const uint32_t i, const std::size_t first_face) {
+                for (auto f = first_face; f < faces.size(); ++f) {
+                    if (faces[f].alive && glm::dot(faces[f].normal, points[i]) - faces[f].offset > tolerance) {
+                        faces[f].outside.push_back(i);
+                        return;
+                    }
+                }
+            };
+            for (uint32_t i = 0; i < points.size(); ++i) {
+                if (!on_hull[i]) { assign(i, 0); }
+            }
+
+            std::vector<std::size_t> visible;
+            std::vector<std::pair<uint32_t, uint32_t>> edges;
+            std::vector<uint32_t> orphans;
+            for (auto num_vertices = 4u; num_vertices < max_vertices; ++num_vertices) {
+                // the point furthest outside of any face goes in next, so a vertex limited hull keeps
+                // the points that matter most for its shape
+                auto eye = 0u;
+                auto eye_dist = 0.0f;
+                for (const auto& f : faces) {
+                    if (!f.alive) { continue; }
+                    for (const auto i : f.outside) {
+                        if (const auto d = glm::dot(f.normal, points[i]) - f.offset; d > eye_dist) {
+                            eye = i;
+                            eye_dist = d;
+                        }
+                    }
+                }
+                if (eye_dist <= 0.0f) { break; }
+
+                const auto& eye_point = points[eye];
+                visible.clear();
+                edges.clear();
+                orphans.clear();
+                for (std::size_t f = 0; f < faces.size(); ++f) {
+                    auto& face = faces[f];
+                    if (!face.alive || glm::dot(face.normal, eye_point) - face.offset <= tolerance) { continue; }
+                    visible.push_back(f);
+                    for (auto e = 0; e < 3; ++e) { edges.emplace_back(face.v[e], face.v[(e + 1) % 3]); }
+                    orphans.insert(orphans.end(), face.outside.begin(), face.outside.end());
+                    face.outside.clear();
+                    face.alive = false;
+                }
+
+                // an edge of a visible face whose twin isn't visible is on the horizon, keeping its winding
+                // keeps the new face pointing outwards
+                const auto first_new = faces.size();
+                for (const auto& [a, b] : edges) {
+                    if (std::ranges::find(edges, std::make_pair(b, a)) != edges.end()) { continue; }
+                    faces.push_back(make_face(points, a, b, eye));
+                }
+                on_hull[eye] = 1;
+                for (const auto i : orphans) {
+                    if (!on_hull[i]) { assign(i, first_new); }
+                }
+            }
+
+            // compact the vertices that are still referenced and gather the edges as adjacency rows
+            std::vector<uint32_t> remap(points.size(), ~0u);
+            std::set<std::pair<uint32_t, uint32_t>> hull_edges;
+            for (const auto& f : faces) {
+                if (!f.alive) { continue; }
+                uint32_t v[3];
+                for (auto e = 0; e < 3; ++e) {
+                    if (remap[f.v[e]] == ~0u) {
+                        remap[f.v[e]] = static_cast<uint32_t>(hull.vertices.size());
+                        hull.vertices.push_back(points[f.v[e]]);
+                    }
+                    v[e] = remap[f.v[e]];
+                }
+                for (auto e = 0; e < 3; ++e) {
+                    hull_edges.emplace(v[e], v[(e + 1) % 3]);
+                    hull_edges.emplace(v[(e + 1) % 3], v[e]);
+                }
+                planes.emplace_back(f.normal, f.offset);
+            }
+
+            // the set is ordered by the first vertex so it already is the row layout
+            const auto num_vertices = hull.vertices.size();
+            hull.adjacency_offsets.assign(num_vertices + 1, 0);
+            hull.adjacency.reserve(hull_edges.size());
+            for (const auto& [a, b] : hull_edges) {
+                ++hull.adjacency_offsets[a + 1];
+                hull.adjacency.push_back(b);
+            }
+            for (std::size_t v = 0; v < num_vertices; ++v) {
+                hull.adjacency_offsets[v + 1] += hull.adjacency_offsets[v];
+            }
+
+            hull.min_bound = glm::vec3(max_f);
+            hull.max_bound = glm::vec3(-max_f);
+            for (const auto& v : hull.vertices) {
+                hull.min_bound = glm::min(hull.min_bound, v);
+                hull.max_bound = glm::max(hull.max_bound, v);
+            }
+            return true;
+        }
+
+        struct DecompositionPart {
+            std::vector<uint32_t> triangles;
+            ConvexHull hull;
+            // furthest the surface of the part is from its hull
+            float concavity = 0.0f;
+            glm::vec3 deepest = glm::vec3(0);
+        };
+
+        struct DecompositionInput {
+            std::vector<ColliderMesh::Triangle> triangles;
+            // flat parts are extruded this far and parts within it of their hull are left alone
+            float threshold = 0.0f;
+        };
+
+        DecompositionPart make_part(const DecompositionInput& in, std::vector<uint32_t> triangles) {
+            DecompositionPart part;
+            part.triangles = std::move(triangles);
+
+            std::vector<glm::vec3> points;
+            points.reserve(3 * part.triangles.size());
+            glm::vec3 normal(0);
+            for (const auto t : part.triangles) {
+                const auto& tri = in.triangles[t];
+                points.push_back(tri.v0);
+                points.push_back(tri.v1);
+                points.push_back(tri.v2);
+                normal += tri.norm;
+            }
+            const auto lexical = [](const glm::vec3& a, const glm::vec3& b) {
+                return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z)));
+            };
+            std::ranges::sort(points, lexical);
+            points.erase(std::unique(points.begin(), points.end()), points.end());
+
+            std::vector<glm::vec4> planes;
+            if (!quickhull(points, ConvexHull::max_vertices, part.hull, planes)) {
+                // flat or degenerate, the part grows into the mesh against its normal, or into a box if
+                // it doesn't have one
+                auto extruded = points;
+                const auto n = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0);
+                for (const auto& p : points) { extruded.push_back(p - in.threshold * n); }
+                if (!quickhull(extruded, ConvexHull::max_vertices, part.hull, planes)) {
+                    glm::vec3 lo(max_f), hi(-max_f);
+                    for (const auto& p : points) {
+                        lo = glm::min(lo, p);
+                        hi = glm::max(hi, p);
+                    }
+                    lo -= glm::vec3(0.5f * in.threshold);
+                    hi += glm::vec3(0.5f * in.threshold);
+                    std::vector<glm::vec3> corners;
+                    for (auto i = 0; i < 8; ++i) { corners.push_back(glm::mix(lo, hi, glm::bvec3(i & 1, i & 2, i & 4))); }
+                    quickhull(corners, ConvexHull::max_vertices, part.hull, planes);
+                }
+            }
+
+            // the distance from the surface along its normal out of the hull, zero where the surface is the
+            // hull. unlike the depth below the hull this also sees into open surfaces like a valley
+            for (const auto t : part.triangles) {
+                const auto& tri = in.triangles[t];
+                if (glm::length(tri.norm) <= 0.0f) { continue; }
+                const auto n = glm::normalize(tri.norm);
+                for (const auto& p : {tri.v0, tri.v1, tri.v2, tri.center}) {
+                    auto distance = max_f;
+                    for (const auto& plane : planes) {
+                        if (const auto facing = glm::dot(glm::vec3(plane), n); facing > 0.0f) {
+                            distance = Math::min(distance, (plane.w - glm::dot(glm::vec3(plane), p)) / facing);
+                        }
+                    }
+                    if (distance < max_f && distance > part.concavity) {
+                        part.concavity = distance;
+                        part.deepest = p;
+                    }
+                }
+            }
+            return part;
+        }
+
+        // tries planes through the deepest point and at fixed fractions of the longest axis that still
+        // has triangle centers on both sides, the split whose worse half is closest to convex wins
+        bool split_part(const DecompositionInput& in, const DecompositionPart& part, DecompositionPart out[2]) {
+            glm::vec3 lo(max_f), hi(-max_f);
+            for (const auto t : part.triangles) {
+                lo = glm::min(lo, in.triangles[t].center);
+                hi = glm::max(hi, in.triangles[t].center);
+            }
+            const auto extent = hi - lo;
+            int axes[3] = {0, 1, 2};
+            std::ranges::sort(axes, [&](const int a, const int b) { return extent[a] > extent[b]; });
+
+            auto best_score = max_f;
+            for (const auto axis : axes) {
+                float positions[std::size(ConvexDecomposition::split_candidates) + 1];
+                positions[0] = part.deepest[axis];
+                for (std::size_t i = 0; i < std::size(ConvexDecomposition::split_candidates); ++i) {
+                    positions[i + 1] = lo[axis] + ConvexDecomposition::split_candidates[i] * extent[axis];
+                }
+                for (const auto position : positions) {
+                    std::vector<uint32_t> halves[2];
+                    for (const auto t : part.triangles) {
+                        halves[in.triangles[t].center[axis] < position ? 0 : 1].push_back(t);
+                    }
+                    if (halves[0].empty() || halves[1].empty()) { continue; }
+
+                    auto a = make_part(in, std::move(halves[0]));
+                    auto b = make_part(in, std::move(halves[1]));
+                    if (const auto score = Math::max(a.concavity, b.concavity); score < best_score) {
+                        best_score = score;
+                        out[0] = std::move(a);
+                        out[1] = std::move(b);
+                    }
+                }
+                if (best_score < max_f) { return true; }
+            }
+            return false;
+        }
+
+    }
+
+    bool ConvexHull::build(const std::vector<glm::vec3>& points, const uint32_t max_vertices) {
+        std::vector<glm::vec4> planes;
+        return Internal::quickhull(points, max_vertices, *this, planes);
+    }
+
+    glm::vec3 ConvexHull::furthest_along(const glm::vec3& dir, uint32_t& hint) const {
+        const auto num_vertices = static_cast<uint32_t>(this->vertices.size());
+        if (num_vertices < hill_climb_min_vertices) {
+            auto best_dist{-max_f};
+            for (uint32_t v = 0; v < num_vertices; ++v) {
+                if (const auto dist = glm::dot(this->vertices[v], dir);
+                    dist > best_dist) {
+                    hint = v;
+                    best_dist = dist;
+                }
+            }
+            return this->vertices[hint];
+        }
+
+        auto best = hint < num_vertices ? hint : 0;
+        auto best_dist = glm::dot(this->vertices[best], dir);
+        // steepest ascent, on a convex surface the first vertex without a better neighbour is the support
+        for (;;) {
+            auto next_best = best;
+            for (auto e = this->adjacency_offsets[best]; e < this->adjacency_offsets[best + 1]; ++e) {
+                const auto next = this->adjacency[e];
+                if (const auto dist = glm::dot(this->vertices[next], dir);
+                    dist > best_dist) {
+                    next_best = next;
+                    best_dist = dist;
+                }
+            }
+            if (next_best == best) { break; }
+            best = next_best;
+        }
+        hint = best;
+        return this->vertices[best];
+    }
+
+    void ConvexDecomposition::build(const ColliderMesh& mesh, std::vector<ConvexHull>& out_hulls) {
+        Internal::DecompositionInput in;
+        glm::vec3 lo(max_f), hi(-max_f);
+        std::vector<uint32_t> all;
+        for (const auto& p : mesh.primitives) {
+            for (const auto& t : p.triangles) {
+                all.push_back(static_cast<uint32_t>(in.triangles.size()));
+                in.triangles.push_back(t);
+                lo = glm::min(lo, glm::min(t.v0, glm::min(t.v1, t.v2)));
+                hi = glm::max(hi, glm::max(t.v0, glm::max(t.v1, t.v2)));
+            }
+        }
+        out_hulls.clear();
+        if (in.triangles.empty()) { return; }
+        in.threshold = max_concavity * glm::length(hi - lo);
+
+        std::vector<Internal::DecompositionPart> parts;
+        parts.push_back(Internal::make_part(in, std::move(all)));
+        while (parts.size() < max_parts) {
+            const auto worst = std::ranges::max_element(parts, {}, &Internal::DecompositionPart::concavity);
+            if (worst->concavity <= in.threshold) { break; }
+
+            if (Internal::DecompositionPart halves[2]; Internal::split_part(in, *worst, halves)) {
+                *worst = std::move(halves[0]);
+                parts.push_back(std::move(halves[1]));
+            }
+            else {
+                // every triangle center sits on one point, there is nothing left to split
+                worst->concavity = 0.0f;
+            }
+        }
+
+        out_hulls.reserve(parts.size());
+        for (auto& part : parts) {
+            if (!part.hull.vertices.empty()) { out_hulls.push_back(std::move(part.hull)); }
+        }
+    }
+
+} // namespace Physics
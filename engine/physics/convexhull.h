@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <vector>
+
+#include "physicsresource.h"
+#include "vec3.hpp"
+
+
+namespace Physics {
+
+    struct ColliderMesh;
+
+    // convex hull of a mesh or of a part of it, gjk and epa only ever see these so that the cost of a
+    // support query is bounded by max_vertices whatever the render mesh looks like
+    struct ConvexHull {
+        // quickhull adds the point furthest outside first, stopping at the limit leaves out the points
+        // closest to the hull
+        static constexpr auto max_vertices = 64u;
+        // below this many vertices a linear support scan beats walking the adjacency
+        static constexpr auto hill_climb_min_vertices = 32u;
+
+        // hull vertices with their edge adjacency in compressed rows
+        std::vector<glm::vec3> vertices;
+        std::vector<uint32_t> adjacency_offsets;
+        std::vector<uint32_t> adjacency;
+        glm::vec3 min_bound = glm::vec3(0);
+        glm::vec3 max_bound = glm::vec3(0);
+
+        // false if the points are coplanar or closer together than the tolerance, the hull is left empty
+        bool build(const std::vector<glm::vec3>& points, uint32_t max_vertices = ConvexHull::max_vertices);
+        // local space support point, hint is the vertex the previous query ended on and is updated
+        [[nodiscard]] glm::vec3 furthest_along(const glm::vec3& dir, uint32_t& hint) const;
+    };
+
+    // approximate convex decomposition, the part that is furthest from being convex is split in two
+    // along its longest axis until every part is within max_concavity of its hull or there are max_parts.
+    // a convex mesh comes out as a single hull, flat parts are given max_concavity thickness below their
+    // surface so that a level mesh still has a volume to push out of
+    struct ConvexDecomposition {
+        static constexpr auto max_parts = 16u;
+        // furthest the surface of a part may be from its hull along the surface normal, relative to the
+        // diagonal of the whole mesh
+        static constexpr auto max_concavity = 0.05f;
+        // fractions of the longest axis tried as split planes besides the deepest point
+        static constexpr float split_candidates[] = {0.25f, 0.5f, 0.75f};
+
+        static void build(const ColliderMesh& mesh, std::vector<ConvexHull>& out_hulls);
+    };
+
+} // namespace Physics
@@ -0,0 +1,409 @@
+﻿#include "config.h"
+#include "integrator.h"
+
+#include <cstddef>
+#if defined(PHYSICS_AVX2)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// msvc emits the intrinsics as they are, the rest of the file stays at the target's baseline
+#define PHYSICS_TARGET_AVX2
+#else
+// only the kernels are built for avx2, a file or target wide -mavx2 would let avx2 copies of the
+// inline glm and std functions leak into the rest of the library
+#define PHYSICS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "core/jobsystem.h"
+#include "physics/phy.h"
+#include "physics/physicsmesh.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        void body_forces(Colliders& colliders, const uint32_t i, const float dt) {
+            auto& dyn = colliders.dynamics;
+            const auto& state = colliders.states[i];
+            colliders.prev_positions[i] = dyn.pos[i];
+            colliders.prev_rotations[i] = dyn.rot[i];
+
+            const auto rotm = glm::mat3_cast(dyn.rot[i]);
+            const auto inv_inertia_tensor = rotm * state.inv_inertia_shape * glm::transpose(rotm);
+            // kinematic bodies have no mass and don't fall
+            const auto fall = state.inv_mass > 0.0f ? gravity * dt : glm::vec3(0);
+            dyn.vel[i] += fall + dyn.impulse_accum[i] * state.inv_mass;
+            dyn.angular_vel[i] += inv_inertia_tensor * dyn.torque_accum[i];
+
+            dyn.impulse_accum[i] = glm::vec3(0);
+            dyn.torque_accum[i] = glm::vec3(0);
+        }
+
+        void body_motion(Colliders& colliders, const std::vector<AABB>& mesh_aabbs, const uint32_t i, const float dt) {
+            auto& dyn = colliders.dynamics;
+            dyn.pos[i] += dyn.vel[i] * dt;
+            dyn.rot[i] = glm::normalize(dyn.rot[i] + 0.5f * glm::quat(0.0f, dyn.angular_vel[i]) * dyn.rot[i] * dt);
+
+            const auto resting =
+                glm::dot(dyn.vel[i], dyn.vel[i]) < sleep_linear_velocity * sleep_linear_velocity &&
+                glm::dot(dyn.angular_vel[i], dyn.angular_vel[i]) < sleep_angular_velocity * sleep_angular_velocity;
+            colliders.sleep_timers[i] = resting ? colliders.sleep_timers[i] + dt : 0.0f;
+
+            colliders.transforms[i] = glm::translate(dyn.pos[i]) * glm::mat4_cast(dyn.rot[i]) * glm::scale(colliders.states[i].scale);
+            colliders.aabbs[i] = rotate_aabb_affine(mesh_aabbs[colliders.meshes[i].index], colliders.transforms[i]);
+        }
+
+#if defined(PHYSICS_AVX2)
+        constexpr auto lanes = 8;
+
+        // the batch kernels are only taken on cpus that have avx2, checked once on the first step
+        bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) { return false; }
+            __cpuidex(info, 7, 0);
+            const auto avx2 = (info[1] & (1 << 5)) != 0;
+            // the os has to save the ymm registers as well
+            __cpuid(info, 1);
+            const auto osxsave = (info[2] & (1 << 27)) != 0;
+            return avx2 && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        bool use_avx2() {
+            static const auto supported = cpu_has_avx2();
+            return supported;
+        }
+
+        // the arrays are read as plain floats, these are the strides and field offsets in floats
+        static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+        static_assert(sizeof(glm::quat) == 4 * sizeof(float));
+        static_assert(sizeof(glm::mat4) == 16 * sizeof(float));
+        static_assert(sizeof(AABB) == 6 * sizeof(float));
+        static_assert(sizeof(State) % sizeof(float) == 0);
+        constexpr int32_t state_stride = sizeof(State) / sizeof(float);
+        constexpr auto state_inv_inertia = offsetof(State, inv_inertia_shape) / sizeof(float);
+        constexpr auto state_scale = offsetof(State, scale) / sizeof(float);
+        constexpr auto state_inv_mass = offsetof(State, inv_mass) / sizeof(float);
+        constexpr auto quat_x = offsetof(glm::quat, x) / sizeof(float);
+        constexpr auto quat_y = offsetof(glm::quat, y) / sizeof(float);
+        constexpr auto quat_z = offsetof(glm::quat, z) / sizeof(float);
+        constexpr auto quat_w = offsetof(glm::quat, w) / sizeof(float);
+
+        template<typename T>
+        float* floats(std::vector<T>& v) { return reinterpret_cast<float*>(v.data()); }
+
+        template<typename T>
+        const float* floats(const std::vector<T>& v) { return reinterpret_cast<const float*>(v.data()); }
+
+        // offsets of the same element in eight array entries, the gathers read through them and the
+        // results go back lane by lane as avx2 has no scatter
+        struct Offsets {
+            __m256i vec;
+            alignas(32) int32_t lane[lanes];
+        };
+
+        PHYSICS_TARGET_AVX2
+        Offsets offsets(const __m256i index, const int32_t stride) {
+            Offsets o;
+            o.vec = _mm256_mullo_epi32(index, _mm256_set1_epi32(stride));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(o.lane), o.vec);
+            return o;
+        }
+
+        PHYSICS_TARGET_AVX2
+        __m256 gather(const float* base, const Offsets& o) {
+            return _mm256_i32gather_ps(base, o.vec, sizeof(float));
+        }
+
+        PHYSICS_TARGET_AVX2
+        void scatter(float* base, const Offsets& o, const __m256 v) {
+            alignas(32) float values[lanes];
+            _mm256_store_ps(values, v);
+            for (auto l = 0; l < lanes; ++l) {
+                base[o.lane[l]] = values[l];
+            }
+        }
+
+        struct Vec8 {
+            __m256 x, y, z;
+        };
+
+        PHYSICS_TARGET_AVX2
+        Vec8 gather3(const float* base, const Offsets& o) {
+            return {gather(base, o), gather(base + 1, o), gather(base + 2, o)};
+        }
+
+        PHYSICS_TARGET_AVX2
+        void scatter3(float* base, const Offsets& o, const Vec8& v) {
+            scatter(base, o, v.x);
+            scatter(base + 1, o, v.y);
+            scatter(base + 2, o, v.z);
+        }
+
+        PHYSICS_TARGET_AVX2
+        __m256 madd(const __m256 a, const __m256 b, const __m256 c) {
+            return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+        }
+
+        PHYSICS_TARGET_AVX2
+        __m256 dot(const Vec8& a, const Vec8& b) {
+            return madd(a.x, b.x, madd(a.y, b.y, _mm256_mul_ps(a.z, b.z)));
+        }
+
+        // rotation matrix of eight quaternions, m[c] is column c like glm
+        struct Mat8 {
+            Vec8 m[3];
+
+            PHYSICS_TARGET_AVX2
+            Mat8(const __m256 x, const __m256 y, const __m256 z, const __m256 w) {
+                const auto one = _mm256_set1_ps(1.0f);
+                const auto two = _mm256_set1_ps(2.0f);
+                const auto xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+                const auto xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+                const auto wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+                this->m[0] = {
+                    _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))),
+                    _mm256_mul_ps(two, _mm256_add_ps(xy, wz)),
+                    _mm256_mul_ps(two, _mm256_sub_ps(xz, wy))
+                };
+                this->m[1] = {
+                    _mm256_mul_ps(two, _mm256_sub_ps(xy, wz)),
+                    _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))),
+                    _mm256_mul_ps(two, _mm256_add_ps(yz, wx))
+                };
+                this->m[2] = {
+                    _mm256_mul_ps(two, _mm256_add_ps(xz, wy)),
+                    _mm256_mul_ps(two, _mm256_sub_ps(yz, wx)),
+                    _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy)))
+                };
+            }
+
+            PHYSICS_TARGET_AVX2
+            [[nodiscard]] Vec8 mul(const Vec8& v) const {
+                return {
+                    madd(this->m[0].x, v.x, madd(this->m[1].x, v.y, _mm256_mul_ps(this->m[2].x, v.z))),
+                    madd(this->m[0].y, v.x, madd(this->m[1].y, v.y, _mm256_mul_ps(this->m[2].y, v.z))),
+                    madd(this->m[0].z, v.x, madd(this->m[1].z, v.y, _mm256_mul_ps(this->m[2].z, v.z)))
+                };
+            }
+
+            PHYSICS_TARGET_AVX2
+            [[nodiscard]] Vec8 mul_transposed(const Vec8& v) const {
+                return {dot(this->m[0], v), dot(this->m[1], v), dot(this->m[2], v)};
+            }
+        };
+
+        PHYSICS_TARGET_AVX2
+        void batch_forces(Colliders& colliders, const uint32_t* bodies, const float dt) {
+            auto& dyn = colliders.dynamics;
+            for (auto l = 0; l < lanes; ++l) {
+                colliders.prev_positions[bodies[l]] = dyn.pos[bodies[l]];
+                colliders.prev_rotations[bodies[l]] = dyn.rot[bodies[l]];
+            }
+
+            const auto index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bodies));
+            const auto o3 = offsets(index, 3);
+            const auto o4 = offsets(index, 4);
+            const auto os = offsets(index, state_stride);
+            const auto* states = floats(colliders.states);
+            const auto* rot = floats(dyn.rot);
+
+            const auto inv_mass = gather(states + state_inv_mass, os);
+            const auto impulse = gather3(floats(dyn.impulse_accum), o3);
+            auto vel = gather3(floats(dyn.vel), o3);
+            const auto has_mass = _mm256_cmp_ps(inv_mass, _mm256_setzero_ps(), _CMP_GT_OQ);
+            vel.x = madd(impulse.x, inv_mass, _mm256_add_ps(vel.x, _mm256_and_ps(has_mass, _mm256_set1_ps(gravity.x * dt))));
+            vel.y = madd(impulse.y, inv_mass, _mm256_add_ps(vel.y, _mm256_and_ps(has_mass, _mm256_set1_ps(gravity.y * dt))));
+            vel.z = madd(impulse.z, inv_mass, _mm256_add_ps(vel.z, _mm256_and_ps(has_mass, _mm256_set1_ps(gravity.z * dt))));
+            scatter3(floats(dyn.vel), o3, vel);
+
+            // the torque goes into body space, through the inverse inertia and back out
+            const Mat8 rotm(gather(rot + quat_x, o4), gather(rot + quat_y, o4), gather(rot + quat_z, o4), gather(rot + quat_w, o4));
+            const auto local_torque = rotm.mul_transposed(gather3(floats(dyn.torque_accum), o3));
+            const auto* inertia = states + state_inv_inertia;
+            const auto column_0 = gather3(inertia, os);
+            const auto column_1 = gather3(inertia + 3, os);
+            const auto column_2 = gather3(inertia + 6, os);
+            const Vec8 local_delta = {
+                madd(column_0.x, local_torque.x, madd(column_1.x, local_torque.y, _mm256_mul_ps(column_2.x, local_torque.z))),
+                madd(column_0.y, local_torque.x, madd(column_1.y, local_torque.y, _mm256_mul_ps(column_2.y, local_torque.z))),
+                madd(column_0.z, local_torque.x, madd(column_1.z, local_torque.y, _mm256_mul_ps(column_2.z, local_torque.z)))
+            };
+            const auto delta = rotm.mul(local_delta);
+            auto angular_vel = gather3(floats(dyn.angular_vel), o3);
+            angular_vel.x = _mm256_add_ps(angular_vel.x, delta.x);
+            angular_vel.y = _mm256_add_ps(angular_vel.y, delta.y);
+            angular_vel.z = _mm256_add_ps(angular_vel.z, delta.z);
+            scatter3(floats(dyn.angular_vel), o3, angular_vel);
+
+            for (auto l = 0; l < lanes; ++l) {
+                dyn.impulse_accum[bodies[l]] = glm::vec3(0);
+                dyn.torque_accum[bodies[l]] = glm::vec3(0);
+            }
+        }
+
+        PHYSICS_TARGET_AVX2
+        void batch_motion(Colliders& colliders, const std::vector<AABB>& mesh_aabbs, const uint32_t* bodies, const float dt) {
+            auto& dyn = colliders.dynamics;
+            const auto index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bodies));
+            const auto o1 = offsets(index, 1);
+            const auto o3 = offsets(index, 3);
+            const auto o4 = offsets(index, 4);
+            const auto o6 = offsets(index, 6);
+            const auto o16 = offsets(index, 16);
+            const auto os = offsets(index, state_stride);
+            const auto vdt = _mm256_set1_ps(dt);
+
+            const auto vel = gather3(floats(dyn.vel), o3);
+            auto pos = gather3(floats(dyn.pos), o3);
+            pos.x = madd(vel.x, vdt, pos.x);
+            pos.y = madd(vel.y, vdt, pos.y);
+            pos.z = madd(vel.z, vdt, pos.z);
+            scatter3(floats(dyn.pos), o3, pos);
+
+            // q += 0.5 * dt * (0, w) * q, then normalized
+            auto* rot = floats(dyn.rot);
+            const auto w = gather3(floats(dyn.angular_vel), o3);
+            auto qx = gather(rot + quat_x, o4);
+            auto qy = gather(rot + quat_y, o4);
+            auto qz = gather(rot + quat_z, o4);
+            auto qw = gather(rot + quat_w, o4);
+            const auto half_dt = _mm256_set1_ps(0.5f * dt);
+            const auto dx = _mm256_sub_ps(madd(w.x, qw, _mm256_mul_ps(w.y, qz)), _mm256_mul_ps(w.z, qy));
+            const auto dy = _mm256_sub_ps(madd(w.y, qw, _mm256_mul_ps(w.z, qx)), _mm256_mul_ps(w.x, qz));
+            const auto dz = _mm256_sub_ps(madd(w.z, qw, _mm256_mul_ps(w.x, qy)), _mm256_mul_ps(w.y, qx));
+            const auto dw = dot(w, {qx, qy, qz});
+            qx = madd(dx, half_dt, qx);
+            qy = madd(dy, half_dt, qy);
+            qz = madd(dz, half_dt, qz);
+            qw = _mm256_sub_ps(qw, _mm256_mul_ps(dw, half_dt));
+            // a zero quaternion turns into the identity like it does in glm::normalize
+            const auto length_sq = madd(qx, qx, madd(qy, qy, madd(qz, qz, _mm256_mul_ps(qw, qw))));
+            const auto valid = _mm256_cmp_ps(length_sq, _mm256_setzero_ps(), _CMP_GT_OQ);
+            const auto inv_length = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(length_sq));
+            qx = _mm256_and_ps(valid, _mm256_mul_ps(qx, inv_length));
+            qy = _mm256_and_ps(valid, _mm256_mul_ps(qy, inv_length));
+            qz = _mm256_and_ps(valid, _mm256_mul_ps(qz, inv_length));
+            qw = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(qw, inv_length), valid);
+            scatter(rot + quat_x, o4, qx);
+            scatter(rot + quat_y, o4, qy);
+            scatter(rot + quat_z, o4, qz);
+            scatter(rot + quat_w, o4, qw);
+
+            const auto resting = _mm256_and_ps(
+                _mm256_cmp_ps(dot(vel, vel), _mm256_set1_ps(sleep_linear_velocity * sleep_linear_velocity), _CMP_LT_OQ),
+                _mm256_cmp_ps(dot(w, w), _mm256_set1_ps(sleep_angular_velocity * sleep_angular_velocity), _CMP_LT_OQ)
+                );
+            auto* timers = colliders.sleep_timers.data();
+            scatter(timers, o1, _mm256_and_ps(resting, _mm256_add_ps(gather(timers, o1), vdt)));
+
+            // columns of rotation times scale, the transform is translate * rotate * scale
+            Mat8 m(qx, qy, qz, qw);
+            const auto scale = gather3(floats(colliders.states) + state_scale, os);
+            const __m256 scales[3] = {scale.x, scale.y, scale.z};
+            const auto zero = _mm256_setzero_ps();
+            auto* transforms = floats(colliders.transforms);
+            for (auto c = 0; c < 3; ++c) {
+                m.m[c].x = _mm256_mul_ps(m.m[c].x, scales[c]);
+                m.m[c].y = _mm256_mul_ps(m.m[c].y, scales[c]);
+                m.m[c].z = _mm256_mul_ps(m.m[c].z, scales[c]);
+                scatter3(transforms + 4 * c, o16, m.m[c]);
+                scatter(transforms + 4 * c + 3, o16, zero);
+            }
+            scatter3(transforms + 12, o16, pos);
+            scatter(transforms + 15, o16, _mm256_set1_ps(1.0f));
+
+            // every column adds its smaller and larger end over the mesh bounds, same as AABB::grow_rot
+            alignas(32) int32_t meshes[lanes];
+            for (auto l = 0; l < lanes; ++l) {
+                meshes[l] = static_cast<int32_t>(colliders.meshes[bodies[l]].index);
+            }
+            const auto mesh_bounds = offsets(_mm256_load_si256(reinterpret_cast<const __m256i*>(meshes)), 6);
+            const auto* local = floats(mesh_aabbs);
+            const auto local_min = gather3(local, mesh_bounds);
+            const auto local_max = gather3(local + 3, mesh_bounds);
+            const __m256 mins[3] = {local_min.x, local_min.y, local_min.z};
+            const __m256 maxs[3] = {local_max.x, local_max.y, local_max.z};
+            auto lo = pos;
+            auto hi = pos;
+            for (auto c = 0; c < 3; ++c) {
+                const Vec8 a = {_mm256_mul_ps(m.m[c].x, mins[c]), _mm256_mul_ps(m.m[c].y, mins[c]), _mm256_mul_ps(m.m[c].z, mins[c])};
+                const Vec8 b = {_mm256_mul_ps(m.m[c].x, maxs[c]), _mm256_mul_ps(m.m[c].y, maxs[c]), _mm256_mul_ps(m.m[c].z, maxs[c])};
+                lo.x = _mm256_add_ps(lo.x, _mm256_min_ps(a.x, b.x));
+                lo.y = _mm256_add_ps(lo.y, _mm256_min_ps(a.y, b.y));
+                lo.z = _mm256_add_ps(lo.z, _mm256_min_ps(a.z, b.z));
+                hi.x = _mm256_add_ps(hi.x, _mm256_max_ps(a.x, b.x));
+                hi.y = _mm256_add_ps(hi.y, _mm256_max_ps(a.y, b.y));
+                hi.z = _mm256_add_ps(hi.z, _mm256_max_ps(a.z, b.z));
+            }
+            auto* aabbs = floats(colliders.aabbs);
+            scatter3(aabbs, o6, lo);
+            scatter3(aabbs + 3, o6, hi);
+        }
+#endif
+
+    }
+
+    namespace Internal {
+
+        // bodies per job, a multiple of the avx2 width so only the last range has a scalar tail
+        constexpr auto integrate_grain = 1024;
+
+        void forces_range(Colliders& colliders, const uint32_t* bodies, const std::size_t count, const float dt) {
+            std::size_t k = 0;
+#if defined(PHYSICS_AVX2)
+            if (use_avx2()) {
+                for (; k + lanes <= count; k += lanes) {
+                    batch_forces(colliders, bodies + k, dt);
+                }
+            }
+#endif
+            for (; k < count; ++k) {
+                body_forces(colliders, bodies[k], dt);
+            }
+        }
+
+        void motion_range(
+            Colliders& colliders, const std::vector<AABB>& mesh_aabbs, const uint32_t* bodies, const std::size_t count,
+            const float dt
+            ) {
+            std::size_t k = 0;
+#if defined(PHYSICS_AVX2)
+            if (use_avx2()) {
+                for (; k + lanes <= count; k += lanes) {
+                    batch_motion(colliders, mesh_aabbs, bodies + k, dt);
+                }
+            }
+#endif
+            for (; k < count; ++k) {
+                body_motion(colliders, mesh_aabbs, bodies[k], dt);
+            }
+        }
+
+    }
+
+    // every body only touches its own slots, so the ranges can run on any thread
+    void integrate_forces(Colliders& colliders, const std::vector<uint32_t>& bodies, const float dt) {
+        Core::JobSystem::Get().ParallelFor(
+            bodies.size(), Internal::integrate_grain, [&](const std::size_t begin, const std::size_t end) {
+                Internal::forces_range(colliders, bodies.data() + begin, end - begin, dt);
+            });
+    }
+
+    void integrate_motion(
+        Colliders& colliders, const std::vector<AABB>& mesh_aabbs, const std::vector<uint32_t>& bodies, const float dt
+        ) {
+        Core::JobSystem::Get().ParallelFor(
+            bodies.size(), Internal::integrate_grain, [&](const std::size_t begin, const std::size_t end) {
+                Internal::motion_range(colliders, mesh_aabbs, bodies.data() + begin, end - begin, dt);
+            });
+    }
+
+} // namespace Physics
@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <vector>
+
+#include "physicsresource.h"
+
+
+namespace Physics {
+
+    struct AABB;
+    struct Colliders;
+
+    // the bodies are awake dynamic bodies, on cpus with avx2 both passes go through eight of them at a time
+    // and the rest one by one
+
+    // applies gravity and the accumulated impulses and torques, and keeps the pose the step starts from
+    void integrate_forces(Colliders& colliders, const std::vector<uint32_t>& bodies, float dt);
+    // moves the bodies by their velocities, their transforms, aabbs and sleep timers are written in the same pass.
+    // mesh_aabbs are the local bounds of the meshes the colliders use
+    void integrate_motion(
+        Colliders& colliders, const std::vector<AABB>& mesh_aabbs, const std::vector<uint32_t>& bodies, float dt
+        );
+
+} // namespace Physics
@@ -0,0 +1,166 @@
+﻿#include "config.h"
+#include "paircache.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "core/maths.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        float quad_area(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d) {
+            return Math::max(
+                glm::length(glm::cross(a - b, c - d)),
+                glm::length(glm::cross(a - c, b - d)),
+                glm::length(glm::cross(a - d, b - c))
+                );
+        }
+
+        // the entry of a pair whose bodies traded places, a and b side data swaps and the directions turn around
+        void swap_bodies(PairCacheEntry& entry) {
+            auto& manifold = entry.manifold;
+            for (auto i = 0; i < manifold.num_points; ++i) {
+                auto& p = manifold.points[i];
+                std::swap(p.local_a, p.local_b);
+                std::swap(p.world_a, p.world_b);
+            }
+            manifold.normal = -manifold.normal;
+            std::swap(entry.hint.a, entry.hint.b);
+            std::swap(entry.hint.part_a, entry.hint.part_b);
+            entry.axis = -entry.axis;
+        }
+
+    }
+
+    void ContactManifold::refresh(const glm::mat4& ta, const glm::mat4& tb) {
+        for (auto i = 0; i < this->num_points;) {
+            auto& p = this->points[i];
+            p.world_a = ta * glm::vec4(p.local_a, 1.0f);
+            p.world_b = tb * glm::vec4(p.local_b, 1.0f);
+            p.depth = glm::dot(p.world_b - p.world_a, this->normal);
+            const auto lateral = p.world_a - p.world_b + p.depth * this->normal;
+            if (p.depth < -match_distance || glm::dot(lateral, lateral) > match_distance * match_distance) {
+                p = this->points[--this->num_points];
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    void ContactManifold::add(const CollisionInfo& ci, const glm::mat4& ta, const glm::mat4& tb) {
+        ContactPoint contact;
+        contact.world_a = ci.contact_point_a;
+        contact.world_b = ci.contact_point_b;
+        contact.local_a = glm::inverse(ta) * glm::vec4(ci.contact_point_a, 1.0f);
+        contact.local_b = glm::inverse(tb) * glm::vec4(ci.contact_point_b, 1.0f);
+        contact.depth = ci.penetration_depth;
+
+        this->normal = ci.normal;
+        for (auto i = 0; i < this->num_points; ++i) {
+            auto& p = this->points[i];
+            p.depth = glm::dot(p.world_b - p.world_a, this->normal);
+        }
+
+        auto closest = -1;
+        auto closest_dist = match_distance * match_distance;
+        for (auto i = 0; i < this->num_points; ++i) {
+            const auto d = this->points[i].world_a - contact.world_a;
+            if (glm::dot(d, d) < closest_dist) {
+                closest = i;
+                closest_dist = glm::dot(d, d);
+            }
+        }
+        if (closest >= 0) {
+            contact.normal_impulse = this->points[closest].normal_impulse;
+            contact.tangent_impulse[0] = this->points[closest].tangent_impulse[0];
+            contact.tangent_impulse[1] = this->points[closest].tangent_impulse[1];
+            this->points[closest] = contact;
+            return;
+        }
+        if (this->num_points < max_points) {
+            this->points[this->num_points++] = contact;
+            return;
+        }
+
+        // five candidates, keep the deepest one and drop the point whose removal leaves the largest area
+        ContactPoint candidates[max_points + 1];
+        std::copy_n(this->points, max_points, candidates);
+        candidates[max_points] = contact;
+
+        auto deepest = 0;
+        for (auto i = 1; i <= max_points; ++i) {
+            if (candidates[i].depth > candidates[deepest].depth) { deepest = i; }
+        }
+
+        auto drop = -1;
+        auto best_area = -1.0f;
+        for (auto i = 0; i <= max_points; ++i) {
+            if (i == deepest) { continue; }
+            glm::vec3 q[max_points];
+            auto n = 0;
+            for (auto j = 0; j <= max_points; ++j) {
+                if (j != i) { q[n++] = candidates[j].world_a; }
+            }
+            if (const auto area = Internal::quad_area(q[0], q[1], q[2], q[3]);
+                area > best_area) {
+                best_area = area;
+                drop = i;
+            }
+        }
+
+        auto n = 0;
+        for (auto i = 0; i <= max_points; ++i) {
+            if (i != drop) { this->points[n++] = candidates[i]; }
+        }
+    }
+
+    PairCacheEntry& PairCache::get(const uint32_t a, const uint32_t b, const uint32_t step) {
+        const auto lo = Math::min(a, b);
+        const auto hi = Math::max(a, b);
+        auto& entry = this->m_entries[(static_cast<uint64_t>(lo) << 32) | hi];
+        entry.last_step = step;
+        return entry;
+    }
+
+    void PairCache::evict(const uint32_t step) {
+        std::erase_if(this->m_entries, [step](const auto& kv) { return kv.second.last_step != step; });
+    }
+
+    void PairCache::remove_body(const uint32_t body, const uint32_t last) {
+        std::vector<decltype(this->m_entries)::node_type> moved;
+        for (auto it = this->m_entries.begin(); it != this->m_entries.end();) {
+            const auto lo = static_cast<uint32_t>(it->first >> 32);
+            const auto hi = static_cast<uint32_t>(it->first);
+            if (lo == body || hi == body) {
+                it = this->m_entries.erase(it);
+            }
+            else if (lo == last || hi == last) {
+                // extracting keeps the entry where it is in memory, only its key changes
+                const auto next = std::next(it);
+                moved.push_back(this->m_entries.extract(it));
+                it = next;
+            }
+            else {
+                ++it;
+            }
+        }
+        for (auto& node : moved) {
+            const auto lo = static_cast<uint32_t>(node.key() >> 32);
+            const auto other = lo == last ? static_cast<uint32_t>(node.key()) : lo;
+            // a is the lower index of the pair, body can end up on the other side of other than last was
+            if ((lo == last) != (body < other)) {
+                Internal::swap_bodies(node.mapped());
+            }
+            node.key() = (static_cast<uint64_t>(Math::min(other, body)) << 32) | Math::max(other, body);
+            this->m_entries.insert(std::move(node));
+        }
+    }
+
+    void PairCache::clear() {
+        this->m_entries.clear();
+    }
+
+} // namespace Physics
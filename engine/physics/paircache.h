@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <unordered_map>
+
+#include "physicsresource.h"
+
+
+namespace Physics {
+
+    struct ContactPoint {
+        // anchors in the model space of each body, so the point follows the bodies between steps
+        glm::vec3 local_a = glm::vec3(0);
+        glm::vec3 local_b = glm::vec3(0);
+        glm::vec3 world_a = glm::vec3(0);
+        glm::vec3 world_b = glm::vec3(0);
+        float depth = 0.0f;
+        // accumulated solver impulses, kept while the point persists to warm start the next step
+        float normal_impulse = 0.0f;
+        float tangent_impulse[2] = {0.0f, 0.0f};
+    };
+
+    // up to four contacts of a pair collected over several steps, epa only finds one point per step
+    struct ContactManifold {
+        static constexpr auto max_points = 4;
+        // contacts closer than this are treated as the same point, points that drift further are dropped
+        static constexpr auto match_distance = 0.02f;
+
+        ContactPoint points[max_points];
+        // points from body b towards body a
+        glm::vec3 normal = glm::vec3(0);
+        int num_points = 0;
+
+        // moves the points along with the bodies and drops the ones that separated or slid apart
+        void refresh(const glm::mat4& ta, const glm::mat4& tb);
+        void add(const CollisionInfo& ci, const glm::mat4& ta, const glm::mat4& tb);
+        void clear() { this->num_points = 0; }
+    };
+
+    // narrowphase state that survives between steps for every pair the broadphase keeps reporting
+    struct PairCacheEntry {
+        // last separating axis, or the last penetration direction while the pair overlaps
+        glm::vec3 axis = glm::vec3(1, 0, 0);
+        SupportHint hint;
+        ContactManifold manifold;
+        uint32_t last_step = 0;
+    };
+
+    struct PairCache {
+    private:
+        std::unordered_map<uint64_t, PairCacheEntry> m_entries;
+
+    public:
+        // references stay valid until the entry is evicted, the map never moves its nodes
+        PairCacheEntry& get(uint32_t a, uint32_t b, uint32_t step);
+        // drops every pair that was not looked up during the given step
+        void evict(uint32_t step);
+        // drops the pairs of body and moves the pairs of last over to body, last is the collider that
+        // took the place of body in the collider arrays
+        void remove_body(uint32_t body, uint32_t last);
+        void clear();
+
+        [[nodiscard]] std::size_t size() const { return this->m_entries.size(); }
+        // entries keyed by the two collider indices, the lower one in the upper bits. used to snapshot the
+        // warm start impulses, set puts an entry back under its key
+        [[nodiscard]] const std::unordered_map<uint64_t, PairCacheEntry>& entries() const { return this->m_entries; }
+        void set(uint64_t key, const PairCacheEntry& entry) { this->m_entries[key] = entry; }
+    };
+
+} // namespace Physics
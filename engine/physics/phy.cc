@@ -2,11 +2,25 @@
 
 #include "phy.h"
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
 #include "core/cvar.h"
 #include "core/idpool.h"
+#include "core/jobsystem.h"
 #include "core/maths.h"
+#include "physics/aabbtree.h"
+#include "physics/ccd.h"
+#include "physics/integrator.h"
+#include "physics/paircache.h"
 #include "physics/ray.h"
 #include "physics/simplex.h"
+#include "physics/solver.h"
 #include "physics/physicsmesh.h"
 #include "physics/physicsresource.h"
 #include "render/debugrender.h"
@@ -19,27 +33,12 @@ namespace Core {
 
 namespace Physics {
 
-    static Util::IdPool<ColliderId> collider_id_pool;
-    static Colliders colliders_;
-    static auto sort_axis = 0;
     static Core::CVar* s_stop_sim = nullptr;
-
-    static Simplex saved_simplex;
-
-    State::Dyn& State::Dyn::set_pos(const glm::vec3& p) {
-        this->pos = p;
-        return *this;
-    }
-
-    State::Dyn& State::Dyn::set_vel(const glm::vec3& v) {
-        this->vel = v;
-        return *this;
-    }
-
-    State::Dyn& State::Dyn::set_rot(const glm::quat& r) {
-        this->rot = r;
-        return *this;
-    }
+    static Core::CVar* s_broadphase = nullptr;
+    static Core::CVar* s_allow_sleep = nullptr;
+    static Core::CVar* s_narrowphase_threads = nullptr;
+    static Core::CVar* s_solver_iterations = nullptr;
+    static Core::CVar* s_ccd = nullptr;
 
     State& State::set_inertia_tensor(const glm::mat3& m) {
         this->inv_inertia_shape = m;
@@ -61,9 +60,34 @@ namespace Physics {
         return *this;
     }
 
-    const Colliders& get_colliders() { return colliders_; }
-    Colliders& colliders() { return colliders_; }
+    void Dynamics::push_back(const glm::vec3& p, const glm::quat& r) {
+        this->pos.push_back(p);
+        this->vel.emplace_back(0);
+        this->rot.push_back(r);
+        this->angular_vel.emplace_back(0);
+        this->impulse_accum.emplace_back(0);
+        this->torque_accum.emplace_back(0);
+    }
 
+    void Dynamics::remove(const uint32_t index) {
+        const auto last = this->pos.size() - 1;
+        this->pos[index] = this->pos[last];
+        this->vel[index] = this->vel[last];
+        this->rot[index] = this->rot[last];
+        this->angular_vel[index] = this->angular_vel[last];
+        this->impulse_accum[index] = this->impulse_accum[last];
+        this->torque_accum[index] = this->torque_accum[last];
+        this->pos.pop_back();
+        this->vel.pop_back();
+        this->rot.pop_back();
+        this->angular_vel.pop_back();
+        this->impulse_accum.pop_back();
+        this->torque_accum.pop_back();
+    }
+
+    ColliderMeshId World::load_collider_mesh(const std::string& filepath) {
+        return this->m_meshes.load(filepath);
+    }
 
     namespace Internal {
 
@@ -79,12 +103,10 @@ namespace Physics {
                         }
                         )
                     );
-                // case ShapeType::Sphere:
-                //     return {
-                //         {},
-                //         {},
-                //         {}
-                //     };
+            case ShapeType::Sphere: {
+                const auto r = 0.5f * Math::max(cm.width * scale.x, cm.height * scale.y, cm.depth * scale.z);
+                return glm::mat3(1.0f / (2.0f / 5.0f * m * r * r));
+            }
             case ShapeType::Custom:
                 return {
                         {},
@@ -97,455 +119,1516 @@ namespace Physics {
             }
         }
 
+        void swap_remove(std::vector<uint32_t>& v, const uint32_t index) {
+            if (const auto it = std::ranges::find(v, index);
+                it != v.end()) {
+                *it = v.back();
+                v.pop_back();
+            }
+        }
+
+        template <typename T>
+        void remove_at(std::vector<T>& v, const uint32_t index) {
+            v[index] = std::move(v.back());
+            v.pop_back();
+        }
+
     }
 
-    ColliderId create_rigidbody(
-        ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
-        const glm::vec3& scale, float mass, ShapeType type, const uint16_t mask
+    void World::wake_island(const uint32_t index) {
+        auto& colliders = this->m_colliders;
+        if (colliders.is_awake[index] || colliders.is_static[index]) { return; }
+        auto i = index;
+        do {
+            const auto next = colliders.island_links[i];
+            colliders.is_awake[i] = 1;
+            colliders.sleep_timers[i] = 0.0f;
+            colliders.island_links[i] = i;
+            // a body that slept has nothing to blend from until its next step
+            colliders.prev_positions[i] = colliders.dynamics.pos[i];
+            colliders.prev_rotations[i] = colliders.dynamics.rot[i];
+            this->m_awake_bodies.push_back(i);
+            i = next;
+        } while (i != index);
+    }
+
+    // puts a freshly pushed collider into the static or dynamic partition, it can't be in either yet
+    void World::set_partition(const uint32_t index, const bool is_static) {
+        auto& colliders = this->m_colliders;
+        (is_static ? colliders.static_bodies : colliders.dynamic_bodies).push_back(index);
+        colliders.is_static[index] = is_static;
+        if (!is_static) {
+            this->wake_island(index);
+        }
+    }
+
+    // appends a collider to the dense arrays and points a fresh handle at it
+    ColliderId World::push_collider(
+        const ColliderMeshId cm_id, const ShapeType type, const glm::mat4& mat, const glm::vec3& translation,
+        const glm::quat& rotation, const uint16_t mask, const State& state
         ) {
+        auto& colliders = this->m_colliders;
         ColliderId id;
-        const auto mat = glm::translate(translation) * glm::mat4(rotation) * glm::scale(scale);
-        if (collider_id_pool.Allocate(id)) {
-            colliders_.meshes.emplace_back(cm_id);
-            colliders_.transforms.emplace_back(mat);
-            colliders_.aabbs.emplace_back(get_collider_meshes().simple[cm_id.index]);
-            colliders_.masks.emplace_back(mask);
-            State s;
-            s.set_inv_mass(1.0f / mass).set_orig(orig).set_scale(scale);
-            s.set_inertia_tensor(
-                Internal::create_inertia_tensor(type, mass, scale, get_collider_meshes().complex[cm_id.index])
-                );
-            s.dyn.set_pos(translation);
-            s.dyn.set_rot(rotation);
-            colliders_.states.emplace_back(s);
+        this->m_collider_id_pool.Allocate(id);
+        const auto index = static_cast<uint32_t>(colliders.ids.size());
+        if (id.index >= colliders.indices.size()) { colliders.indices.resize(id.index + 1, 0); }
+        colliders.indices[id.index] = index;
+        colliders.ids.emplace_back(id);
+        colliders.meshes.emplace_back(cm_id);
+        colliders.shapes.emplace_back(type);
+        colliders.transforms.emplace_back(mat);
+        colliders.prev_positions.emplace_back(translation);
+        colliders.prev_rotations.emplace_back(rotation);
+        colliders.render_transforms.emplace_back(mat);
+        colliders.aabbs.emplace_back(rotate_aabb_affine(this->m_meshes.simple[cm_id.index], mat));
+        colliders.masks.emplace_back(mask);
+        colliders.filters.emplace_back(this->colliding_layers(mask));
+        colliders.is_static.emplace_back(0);
+        colliders.is_awake.emplace_back(0);
+        colliders.sleep_timers.emplace_back(0.0f);
+        colliders.island_links.emplace_back(index);
+        colliders.states.emplace_back(state);
+        colliders.dynamics.push_back(translation, rotation);
+        return id;
+    }
+
+    uint32_t World::find_island(uint32_t i) {
+        while (this->m_island_roots[i] != i) {
+            this->m_island_roots[i] = this->m_island_roots[this->m_island_roots[i]];
+            i = this->m_island_roots[i];
         }
-        else {
-            colliders_.meshes[id.index] = cm_id;
-            colliders_.transforms[id.index] = mat;
-            colliders_.aabbs[id.index] = get_collider_meshes().simple[cm_id.index];
-            colliders_.masks[id.index] = mask;
-            auto& s = colliders_.states[id.index];
-            s.set_inv_mass(1.0f / mass).set_orig(orig).set_scale(scale);
-            s.set_inertia_tensor(
-                Internal::create_inertia_tensor(type, mass, scale, get_collider_meshes().complex[cm_id.index])
-                );
-            s.dyn.set_pos(translation);
-            s.dyn.set_rot(rotation);
+        return i;
+    }
+
+    // unions the contact graph of the awake bodies into islands and puts every island
+    // to sleep whose bodies have all been resting long enough, bodies without mass don't join islands
+    // so a platform doesn't tie together everything that stands on it
+    void World::update_islands() {
+        auto& colliders = this->m_colliders;
+        this->m_island_roots.resize(colliders.states.size());
+        this->m_island_timers.resize(colliders.states.size());
+        for (const auto i : this->m_awake_bodies) {
+            this->m_island_roots[i] = i;
+            this->m_island_timers[i] = colliders.sleep_timers[i];
+        }
+        for (const auto& ci : this->m_collisions_to_solve) {
+            const auto a = ci.a_index;
+            const auto b = ci.b_index;
+            if (colliders.states[a].inv_mass == 0.0f || colliders.states[b].inv_mass == 0.0f) { continue; }
+            this->m_island_roots[this->find_island(a)] = this->find_island(b);
+        }
+
+        // an island rests only as long as its most recently moving body
+        for (const auto i : this->m_awake_bodies) {
+            const auto root = this->find_island(i);
+            this->m_island_timers[root] = Math::min(this->m_island_timers[root], colliders.sleep_timers[i]);
         }
+
+        std::erase_if(this->m_awake_bodies, [this, &colliders](const uint32_t i) {
+            const auto root = this->find_island(i);
+            if (this->m_island_timers[root] < sleep_time) { return false; }
+            auto& dyn = colliders.dynamics;
+            // a kinematic body keeps the velocity it was given however slow it is
+            if (colliders.states[i].inv_mass == 0.0f &&
+                (dyn.vel[i] != glm::vec3(0) || dyn.angular_vel[i] != glm::vec3(0))) {
+                return false;
+            }
+            if (i != root) {
+                colliders.island_links[i] = colliders.island_links[root];
+                colliders.island_links[root] = i;
+            }
+            dyn.vel[i] = glm::vec3(0);
+            dyn.angular_vel[i] = glm::vec3(0);
+            dyn.impulse_accum[i] = glm::vec3(0);
+            dyn.torque_accum[i] = glm::vec3(0);
+            colliders.is_awake[i] = 0;
+            return true;
+        });
+    }
+
+    ColliderId World::create_rigidbody(
+        ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const glm::vec3& scale, float mass, ShapeType type, const uint16_t mask
+        ) {
+        const auto mat = glm::translate(translation) * glm::mat4(rotation) * glm::scale(scale);
+        State s;
+        s.set_inv_mass(1.0f / mass).set_orig(orig).set_scale(scale);
+        s.set_inertia_tensor(
+            Internal::create_inertia_tensor(type, mass, scale, this->m_meshes.complex[cm_id.index])
+            );
+        const auto id = this->push_collider(cm_id, type, mat, translation, rotation, mask, s);
+        const auto index = this->m_colliders.indices[id.index];
+        this->set_partition(index, false);
+        this->m_aabb_tree.update(index, this->m_colliders.aabbs[index]);
         return id;
     }
 
-    ColliderId create_rigidbody(
+    ColliderId World::create_rigidbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
         const float scale, const float mass, const ShapeType type, const uint16_t mask
         ) {
-        return create_rigidbody(cm_id, orig, translation, rotation, glm::vec3(scale), mass, type, mask);
+        return this->create_rigidbody(cm_id, orig, translation, rotation, glm::vec3(scale), mass, type, mask);
     }
 
-    ColliderId create_staticbody(
+    ColliderId World::create_staticbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
-        const glm::vec3& scale, const uint16_t mask
+        const glm::vec3& scale, const ShapeType type, const uint16_t mask
         ) {
-        ColliderId id;
         const auto mat = glm::translate(translation) * glm::mat4(rotation) * glm::scale(scale);
-        if (collider_id_pool.Allocate(id)) {
-            colliders_.meshes.emplace_back(cm_id);
-            colliders_.transforms.emplace_back(mat);
-            colliders_.aabbs.emplace_back(get_collider_meshes().simple[cm_id.index]);
-            colliders_.masks.emplace_back(mask);
-            State s;
-            s.set_inv_mass(0.0f).set_orig(orig).set_scale(scale);
-            s.set_inertia_tensor(
-                glm::mat3(0.0f)
-                );
-            s.dyn.set_pos(translation);
-            s.dyn.set_rot(rotation);
-            colliders_.states.emplace_back(s);
-        }
-        else {
-            colliders_.meshes[id.index] = cm_id;
-            colliders_.transforms[id.index] = mat;
-            colliders_.aabbs[id.index] = get_collider_meshes().simple[cm_id.index];
-            colliders_.masks[id.index] = mask;
-            auto& s = colliders_.states[id.index];
-            s.set_inv_mass(0.0f).set_orig(orig).set_scale(scale);
-            s.set_inertia_tensor(
-                glm::mat3(0.0f)
-                );
-            s.dyn.set_pos(translation);
-            s.dyn.set_rot(rotation);
-        }
+        State s;
+        s.set_inv_mass(0.0f).set_orig(orig).set_scale(scale);
+        s.set_inertia_tensor(
+            glm::mat3(0.0f)
+            );
+        const auto id = this->push_collider(cm_id, type, mat, translation, rotation, mask, s);
+        const auto index = this->m_colliders.indices[id.index];
+        this->set_partition(index, true);
+        this->m_aabb_tree.update(index, this->m_colliders.aabbs[index]);
         return id;
     }
 
-    ColliderId create_staticbody(
+    ColliderId World::create_staticbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
-        const float scale, const uint16_t mask
+        const float scale, const ShapeType type, const uint16_t mask
         ) {
-        return create_staticbody(cm_id, orig, translation, rotation, glm::vec3(scale), mask);
+        return this->create_staticbody(cm_id, orig, translation, rotation, glm::vec3(scale), type, mask);
+    }
+
+    // a dynamic body without mass, the solver can't change its velocity and integrate_forces skips gravity
+    ColliderId World::create_kinematicbody(
+        ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const glm::vec3& scale, const ShapeType type, const uint16_t mask
+        ) {
+        const auto mat = glm::translate(translation) * glm::mat4(rotation) * glm::scale(scale);
+        State s;
+        s.set_inv_mass(0.0f).set_orig(orig).set_scale(scale);
+        s.set_inertia_tensor(
+            glm::mat3(0.0f)
+            );
+        const auto id = this->push_collider(cm_id, type, mat, translation, rotation, mask, s);
+        const auto index = this->m_colliders.indices[id.index];
+        this->set_partition(index, false);
+        this->m_aabb_tree.update(index, this->m_colliders.aabbs[index]);
+        return id;
+    }
+
+    ColliderId World::create_kinematicbody(
+        ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const float scale, const ShapeType type, const uint16_t mask
+        ) {
+        return this->create_kinematicbody(cm_id, orig, translation, rotation, glm::vec3(scale), type, mask);
+    }
+
+    // the last collider moves into the freed slot, every structure keyed by collider index drops the
+    // removed one and renames the moved one so the arrays stay dense and the handles stay valid
+    void World::destroy_collider(const ColliderId collider) {
+        auto& colliders = this->m_colliders;
+        assert(this->m_collider_id_pool.IsValid(collider));
+        const auto index = colliders.indices[collider.index];
+        const auto last = static_cast<uint32_t>(colliders.ids.size() - 1);
+
+        // whatever rests on the collider has to fall once it is gone
+        this->wake_island(index);
+        this->m_aabb_tree.query(colliders.aabbs[index], [this](const uint32_t j) { this->wake_island(j); });
+        if (this->m_selected_hit.collider == collider) {
+            this->select_triangle(HitInfo());
+        }
+
+        Internal::swap_remove(this->m_awake_bodies, index);
+        Internal::swap_remove(colliders.is_static[index] ? colliders.static_bodies : colliders.dynamic_bodies, index);
+        this->m_aabb_tree.remove_body(index, last);
+        this->m_sweep_and_prune.remove_body(index, last);
+        this->m_pair_cache.remove_body(index, last);
+
+        Internal::remove_at(colliders.ids, index);
+        Internal::remove_at(colliders.meshes, index);
+        Internal::remove_at(colliders.shapes, index);
+        Internal::remove_at(colliders.aabbs, index);
+        Internal::remove_at(colliders.transforms, index);
+        Internal::remove_at(colliders.prev_positions, index);
+        Internal::remove_at(colliders.prev_rotations, index);
+        Internal::remove_at(colliders.render_transforms, index);
+        Internal::remove_at(colliders.states, index);
+        colliders.dynamics.remove(index);
+        Internal::remove_at(colliders.masks, index);
+        Internal::remove_at(colliders.filters, index);
+        Internal::remove_at(colliders.is_static, index);
+        Internal::remove_at(colliders.is_awake, index);
+        Internal::remove_at(colliders.sleep_timers, index);
+        Internal::remove_at(colliders.island_links, index);
+
+        if (index != last) {
+            colliders.indices[colliders.ids[index].index] = index;
+            std::ranges::replace(this->m_awake_bodies, last, index);
+            std::ranges::replace(colliders.is_static[index] ? colliders.static_bodies : colliders.dynamic_bodies, last, index);
+            // the moved body may sleep in an island ring, the body linking to it is found by walking the ring
+            for (auto i = index;; i = colliders.island_links[i]) {
+                if (colliders.island_links[i] == last) {
+                    colliders.island_links[i] = index;
+                    break;
+                }
+            }
+        }
+        this->m_collider_id_pool.Deallocate(collider);
+    }
+
+    uint32_t World::collider_index(const ColliderId collider) const {
+        assert(this->m_collider_id_pool.IsValid(collider));
+        return this->m_colliders.indices[collider.index];
+    }
+
+    bool World::is_valid(const ColliderId collider) const {
+        return this->m_collider_id_pool.IsValid(collider);
+    }
+
+    bool World::is_kinematic(const ColliderId collider) const {
+        const auto index = this->collider_index(collider);
+        return !this->m_colliders.is_static[index] && this->m_colliders.states[index].inv_mass == 0.0f;
+    }
+
+    void World::set_transform(const ColliderId collider, const glm::mat4& t) {
+        auto& colliders = this->m_colliders;
+        const auto index = this->collider_index(collider);
+        colliders.transforms[index] = t;
+        colliders.render_transforms[index] = t;
+        // the integrator moves on from dynamics, without this the body would snap back on its next step
+        auto& dyn = colliders.dynamics;
+        dyn.pos[index] = glm::vec3(t[3]);
+        dyn.rot[index] = glm::normalize(glm::quat_cast(glm::mat3(
+            glm::normalize(glm::vec3(t[0])), glm::normalize(glm::vec3(t[1])), glm::normalize(glm::vec3(t[2]))
+            )));
+        colliders.prev_positions[index] = dyn.pos[index];
+        colliders.prev_rotations[index] = dyn.rot[index];
+        // static bodies are never integrated so their bounds are refreshed here
+        auto& aabb = colliders.aabbs[index];
+        aabb = rotate_aabb_affine(this->m_meshes.simple[colliders.meshes[index].index], t);
+        this->m_aabb_tree.update(index, aabb);
+        // the sweep keeps the static endpoints sorted from its last rebuild
+        if (colliders.is_static[index]) {
+            this->m_sweep_and_prune.clear();
+        }
+        this->wake_island(index);
+    }
+
+    void World::set_velocity(const ColliderId collider, const glm::vec3& linear, const glm::vec3& angular) {
+        const auto index = this->collider_index(collider);
+        assert(!this->m_colliders.is_static[index]);
+        this->wake_island(index);
+        this->m_colliders.dynamics.vel[index] = linear;
+        this->m_colliders.dynamics.angular_vel[index] = angular;
+    }
+
+    void World::set_layer_collision(const uint16_t layers_a, const uint16_t layers_b, const bool collide) {
+        auto& colliders = this->m_colliders;
+        for (auto i = 0; i < 16; ++i) {
+            auto& row = this->m_layer_matrix[i];
+            if (layers_a & (1 << i)) { row = collide ? row | layers_b : row & ~layers_b; }
+            if (layers_b & (1 << i)) { row = collide ? row | layers_a : row & ~layers_a; }
+        }
+        for (std::size_t i = 0; i < colliders.masks.size(); ++i) {
+            colliders.filters[i] = this->colliding_layers(colliders.masks[i]);
+        }
+        // the sweep only looks at pairs whose boxes start or stop overlapping, it starts over so
+        // pairs that are filtered out now are dropped and the newly allowed ones are found
+        this->m_sweep_and_prune.clear();
+    }
+
+    uint16_t World::colliding_layers(const uint16_t mask) const {
+        uint16_t layers = 0;
+        for (auto i = 0; i < 16; ++i) {
+            if (mask & (1 << i)) { layers |= this->m_layer_matrix[i]; }
+        }
+        return layers;
     }
 
-    void set_transform(const ColliderId collider, const glm::mat4& t) {
-        assert(collider_id_pool.IsValid(collider));
-        colliders_.transforms[collider.index] = t;
+    bool World::should_collide(const uint16_t mask_a, const uint16_t mask_b) const {
+        return (this->colliding_layers(mask_a) & mask_b) != 0;
     }
 
     void init_debug() {
         s_stop_sim = Core::CVarCreate(Core::CVar_Int, "s_stop_sim", "0");
+        // 0 = sort and sweep, 1 = dynamic aabb tree
+        s_broadphase = Core::CVarCreate(Core::CVar_Int, "s_broadphase", "0");
+        s_allow_sleep = Core::CVarCreate(Core::CVar_Int, "s_allow_sleep", "1");
+        // threads working on the narrowphase, 0 = the whole job pool, 1 = serial
+        s_narrowphase_threads = Core::CVarCreate(Core::CVar_Int, "s_narrowphase_threads", "0");
+        s_solver_iterations = Core::CVarCreate(Core::CVar_Int, "s_solver_iterations", "10");
+        s_ccd = Core::CVarCreate(Core::CVar_Int, "s_ccd", "1");
     }
 
-    bool cast_ray(const Ray& ray, HitInfo& hit, const uint16_t mask) {
-        std::vector<HitInfo> aabb_hits;
-        for (uint32_t i = 0; i < colliders_.meshes.size(); ++i) {
-            const auto c_mask = colliders_.masks[i];
+    bool World::cast_ray(const Ray& ray, HitInfo& hit, const uint16_t mask) const {
+        const auto& colliders = this->m_colliders;
+        struct Candidate {
+            float t;
+            uint32_t collider;
+            ColliderMeshId mesh;
+        };
+        constexpr auto closer = [](const Candidate& lhs, const Candidate& rhs)-> bool { return lhs.t > rhs.t; };
+
+        // candidate storage is kept between calls so tracing does not hit the heap. a ray can't find more
+        // candidates than there are colliders, so after the first call on a thread it never grows again
+        thread_local std::vector<Candidate> aabb_hits;
+        aabb_hits.clear();
+        aabb_hits.reserve(colliders.aabbs.size());
+        this->m_aabb_tree.cast_ray(ray, [&](const uint32_t i) {
+            const auto c_mask = colliders.masks[i];
             const auto result = (mask & c_mask);
             if (c_mask != CollisionMask::None && result == 0) {
-                continue;
+                return;
             }
-            const auto c = ColliderId(i);
-            const auto cm = colliders_.meshes[i];
-            const auto& aabb = colliders_.aabbs[i];
+            // the tree stores fattened boxes, the tight one gives the entry distance
+            const auto& aabb = colliders.aabbs[i];
             if (HitInfo temp_hit;
                 aabb.intersect(ray, temp_hit)) {
                 if (ray.length != inf_f && temp_hit.t > ray.length) {
-                    continue;
+                    return;
                 }
-                aabb_hits.emplace_back(temp_hit);
-                aabb_hits.back().collider = c;
-                aabb_hits.back().mesh = cm;
+                aabb_hits.push_back({temp_hit.t, i, colliders.meshes[i]});
             }
-        }
+        });
 
         if (aabb_hits.empty()) { return false; }
 
-        std::ranges::sort(
-            aabb_hits
-            , [](const HitInfo& lhs, const HitInfo& rhs)-> bool { return lhs.t < rhs.t; }
-            );
+        // candidates are popped nearest first, once the nearest remaining box starts
+        // behind the best triangle hit nothing left can be closer
+        std::ranges::make_heap(aabb_hits, closer);
 
         HitInfo best_hit;
-        for (const auto it: aabb_hits) {
-            auto& cm = get_collider_meshes().complex[it.mesh.index];
-            const auto& t = colliders_.transforms[it.collider.index];
-            const auto inv_t = glm::inverse(t);
-            const auto model_ray = Ray(
-                inv_t * glm::vec4(ray.orig, 1.0f), Math::safe_normal(inv_t * glm::vec4(ray.dir, 0.0f))
-                );
-
-            for (auto& p: cm.primitives) { for (auto& tri: p.triangles) { tri.selected = false; } }
+        while (!aabb_hits.empty() && aabb_hits.front().t < best_hit.t) {
+            std::ranges::pop_heap(aabb_hits, closer);
+            const auto it = aabb_hits.back();
+            aabb_hits.pop_back();
 
-            if (HitInfo temp_hit;
-                cm.intersect(model_ray, temp_hit)) {
-                // if (ray.length != inf_f && temp_hit.t > ray.length) {
-                //     continue;
-                // }
-                if (temp_hit.t < best_hit.t) {
-                    best_hit = temp_hit;
-                    best_hit.collider = it.collider;
-                    best_hit.mesh = it.mesh;
-                    best_hit.local_dir = model_ray.dir;
-                    best_hit.pos = t * glm::vec4(best_hit.local_pos, 1.0f);
-                    best_hit.norm = t * glm::vec4(best_hit.local_norm, 0.0f);
-                }
+            const auto& cm = this->m_meshes.complex[it.mesh.index];
+            const auto& t = colliders.transforms[it.collider];
+            const auto inv_t = glm::inverse(t);
+            const auto model_dir = glm::vec3(inv_t * glm::vec4(ray.dir, 0.0f));
+            const auto model_ray = Ray(inv_t * glm::vec4(ray.orig, 1.0f), Math::safe_normal(model_dir));
+            // world distances scale by this factor in model space
+            const auto model_scale = glm::length(model_dir);
+
+            // the best hit so far or the end of a finite ray bounds the search, intersect only
+            // reports a hit if it found a triangle in front of that
+            HitInfo temp_hit;
+            if (best_hit.hit()) {
+                temp_hit.t = best_hit.t * model_scale;
+            }
+            else if (ray.length != inf_f) {
+                temp_hit.t = ray.length * model_scale;
+            }
+            if (cm.intersect(model_ray, temp_hit)) {
+                best_hit = temp_hit;
+                best_hit.t = temp_hit.t / model_scale;
+                best_hit.collider = colliders.ids[it.collider];
+                best_hit.mesh = it.mesh;
+                best_hit.local_dir = model_ray.dir;
+                best_hit.pos = t * glm::vec4(best_hit.local_pos, 1.0f);
+                best_hit.norm = t * glm::vec4(best_hit.local_norm, 0.0f);
             }
         }
 
         if (best_hit.hit()) {
             hit = best_hit;
-            get_collider_meshes().complex[hit.mesh.index].primitives[hit.prim_n].triangles[hit.tri_n].selected = true;
             return true;
         }
 
         return false;
     }
 
-    bool cast_ray(const glm::vec3& start, const glm::vec3& dir, HitInfo& hit, const uint16_t mask) {
-        return cast_ray(Ray(start, dir), hit, mask);
+    void World::select_triangle(const HitInfo& hit) {
+        auto& meshes = this->m_meshes.complex;
+        if (const auto& prev = this->m_selected_hit;
+            prev.hit()) {
+            meshes[prev.mesh.index].primitives[prev.prim_n].triangles[prev.tri_n].selected = false;
+        }
+        if (hit.hit()) {
+            meshes[hit.mesh.index].primitives[hit.prim_n].triangles[hit.tri_n].selected = true;
+        }
+        this->m_selected_hit = hit;
     }
 
-    void add_center_impulse(const ColliderId collider, const glm::vec3& dir) {
-        auto& state = colliders_.states[collider.index];
-        state.dyn.impulse_accum += dir;
+    bool World::cast_ray(const glm::vec3& start, const glm::vec3& dir, HitInfo& hit, const uint16_t mask) const {
+        return this->cast_ray(Ray(start, dir), hit, mask);
     }
 
-    void add_impulse(const ColliderId collider, const glm::vec3& loc, const glm::vec3& dir) {
-        auto& state = colliders_.states[collider.index];
-        state.dyn.impulse_accum += dir;
+    namespace Internal {
+
+        // distance the center of moving travels along ray before moving touches target, max_f if it doesn't
+        float swept_entry(const AABB& moving, const Ray& ray, const AABB& target) {
+            const auto half_extent = 0.5f * (moving.max_bound - moving.min_bound);
+            AABB expanded;
+            expanded.min_bound = target.min_bound - half_extent;
+            expanded.max_bound = target.max_bound + half_extent;
+            if (HitInfo temp_hit;
+                expanded.intersect(ray, temp_hit) && temp_hit.t <= ray.length) {
+                return temp_hit.t;
+            }
+            return max_f;
+        }
 
-        state.dyn.torque_accum += glm::cross(
-            loc - state.dyn.pos,
+    }
+
+    // the tree gives the colliders the swept bounds reach, they are tested nearest first by where the
+    // bounds meet like the ray cast does it. each one is sampled along the rest of the motion the way
+    // ccd does it and the first touching sample bisected, epa at that pose gives the normal and contact
+    bool World::cast_collider(const ColliderId collider, const glm::vec3& motion, HitInfo& hit) const {
+        const auto& colliders = this->m_colliders;
+        const auto index = this->collider_index(collider);
+        const auto length = glm::length(motion);
+        if (length <= 0.0f) { return false; }
+
+        struct Candidate {
+            float t;
+            uint32_t collider;
+        };
+        constexpr auto closer = [](const Candidate& lhs, const Candidate& rhs)-> bool { return lhs.t > rhs.t; };
+
+        const auto start_aabb = colliders.aabbs[index];
+        auto swept = start_aabb;
+        swept.min_bound += glm::min(motion, glm::vec3(0));
+        swept.max_bound += glm::max(motion, glm::vec3(0));
+        const auto ray = Ray(0.5f * (start_aabb.min_bound + start_aabb.max_bound), motion, false);
+
+        thread_local std::vector<Candidate> candidates;
+        candidates.clear();
+        const auto filter = colliders.filters[index];
+        this->m_aabb_tree.query(swept, [&](const uint32_t j) {
+            if (j == index || (filter & colliders.masks[j]) == 0) { return; }
+            if (const auto t = Internal::swept_entry(start_aabb, ray, colliders.aabbs[j]); t < max_f) {
+                candidates.push_back({t, j});
+            }
+        });
+        if (candidates.empty()) { return false; }
+        std::ranges::make_heap(candidates, closer);
+
+        // fractions of the motion, apart is the last pose found apart and toi the first one touching
+        auto apart = 1.0f;
+        auto toi = 1.0f;
+        auto hit_index = index;
+        while (!candidates.empty() && candidates.front().t < toi * length) {
+            std::ranges::pop_heap(candidates, closer);
+            const auto b = candidates.back().collider;
+            // the shapes are inside their bounds, they can't touch before the bounds do
+            const auto begin = candidates.back().t / length;
+            candidates.pop_back();
+
+            SupportHint hint;
+            auto axis = glm::vec3(0);
+            // the collider is tested moved along the motion, its transform stays where it is
+            const auto overlaps = [&](const float t) {
+                return this->overlap(index, b, hint, axis, t * motion);
+            };
+
+            if (overlaps(begin)) {
+                apart = begin;
+                toi = begin;
+                hit_index = b;
+                continue;
+            }
+            const auto range = (toi - begin) * length;
+            const auto step = 0.5f * Math::min(Internal::thickness(*this, index), Internal::thickness(*this, b));
+            const auto num_samples = Math::min(Math::max(static_cast<int>(std::ceil(range / step)), 1), ContinuousCollision::max_samples);
+            auto lo = begin;
+            for (auto s = 1; s <= num_samples; ++s) {
+                const auto t = begin + (toi - begin) * static_cast<float>(s) / static_cast<float>(num_samples);
+                if (!overlaps(t)) {
+                    lo = t;
+                    continue;
+                }
+
+                auto hi = t;
+                for (auto i = 0; i < ContinuousCollision::max_bisections && (hi - lo) * length > ContinuousCollision::tolerance; ++i) {
+                    const auto mid = 0.5f * (lo + hi);
+                    (overlaps(mid) ? hi : lo) = mid;
+                }
+                apart = lo;
+                toi = hi;
+                hit_index = b;
+                break;
+            }
+        }
+
+        if (hit_index == index) { return false; }
+
+        // the deepest pair of convex parts at the touching pose gives the contact
+        const auto offset = toi * motion;
+        CollisionInfo contact;
+        contact.normal = -motion / length;
+        contact.contact_point = ray.orig + toi * motion;
+        contact.penetration_depth = -max_f;
+        for (uint32_t pa = 0; pa < this->num_parts(index); ++pa) {
+            const auto bounds_a = this->part_bounds(index, pa, offset);
+            for (uint32_t pb = 0; pb < this->num_parts(hit_index); ++pb) {
+                if (!bounds_a.intersect(this->part_bounds(hit_index, pb))) { continue; }
+                SupportHint hint{0, 0, pa, pb};
+                auto axis = glm::vec3(0);
+                Simplex simplex;
+                if (!this->gjk(index, hit_index, simplex, hint, axis, offset)) { continue; }
+                if (const auto ci = this->epa(simplex, index, hit_index, hint, offset);
+                    ci.has_collision && ci.penetration_depth > contact.penetration_depth) {
+                    contact = ci;
+                }
+            }
+        }
+
+        hit = HitInfo();
+        hit.t = apart * length;
+        hit.pos = contact.contact_point;
+        hit.norm = contact.normal;
+        hit.collider = colliders.ids[hit_index];
+        hit.mesh = colliders.meshes[hit_index];
+        return true;
+    }
+
+    void World::add_center_impulse(const ColliderId collider, const glm::vec3& dir) {
+        const auto index = this->collider_index(collider);
+        this->wake_island(index);
+        this->m_colliders.dynamics.impulse_accum[index] += dir;
+    }
+
+    void World::add_impulse(const ColliderId collider, const glm::vec3& loc, const glm::vec3& dir) {
+        const auto index = this->collider_index(collider);
+        this->wake_island(index);
+        auto& dyn = this->m_colliders.dynamics;
+        dyn.impulse_accum[index] += dir;
+
+        dyn.torque_accum[index] += glm::cross(
+            loc - dyn.pos[index],
             dir
             );
     }
 
-    static std::vector<AABBPair> aabb_collisions;
-    static std::vector<CollisionInfo> collisions_to_solve;
-    static float time_acc = 0.0f;
-    static float physics_step_timer = 1.0f / 60.0f;
+    void World::wake(const ColliderId collider) {
+        this->wake_island(this->collider_index(collider));
+    }
+
+    bool World::is_awake(const ColliderId collider) const {
+        return this->m_colliders.is_awake[this->collider_index(collider)];
+    }
+
+    namespace Internal {
+
+        // below this many pairs handing the pairs to the job pool costs more than it saves
+        constexpr auto parallel_narrowphase_min_pairs = 64;
+        constexpr auto narrowphase_batch_size = 16;
+        // vertices a touching face may have, a larger flat region falls back to the single epa point
+        constexpr auto max_feature_points = 16;
+        constexpr auto max_clip_points = 2 * max_feature_points;
+
+    }
 
-    void step(const float dt) {
-        time_acc += dt;
-        if (time_acc < physics_step_timer) {
+    // gjk and epa between one convex part of each body, returns the contacts of the touching area
+    int World::collide_parts(
+        const uint32_t a, const uint32_t b, SupportHint& hint, glm::vec3& axis, CollisionInfo* out
+        ) const {
+        Simplex simplex;
+        if (!this->gjk(a, b, simplex, hint, axis)) { return 0; }
+        const auto ci = this->epa(simplex, a, b, hint);
+        if (!ci.has_collision) { return 0; }
+
+        // the pair most likely separates along the direction it penetrates in
+        axis = -ci.normal;
+        // the whole touching area is added at once so a resting box gets its four corners on
+        // the first step instead of tipping over the one point epa finds
+        if (const auto num_contacts = this->clip_contacts(ci, hint, out); num_contacts > 0) {
+            return num_contacts;
+        }
+        out[0] = ci;
+        return 1;
+    }
+
+    void World::narrowphase_pair(const std::size_t k) {
+        auto& colliders = this->m_colliders;
+        const auto [a, b] = this->m_aabb_collisions[k];
+        // every pair owns its cache entry so workers never write to shared state
+        auto& entry = *this->m_pair_entries[k];
+        // resting contacts between sleeping and static bodies are not looked at again
+        if (!colliders.is_awake[a] && !colliders.is_awake[b]) {
             return;
         }
-        time_acc = 0.0f;
-        for (std::size_t i = 0; i < colliders_.states.size(); ++i) {
-            auto& state = colliders_.states[i];
-            const auto rotm = glm::mat3_cast(state.dyn.rot);
-            const auto inv_inertia_tensor = rotm * state.inv_inertia_shape * glm::transpose(rotm);
 
-            state.dyn.vel += state.dyn.impulse_accum * state.inv_mass;
-            state.dyn.pos += state.dyn.vel * dt;
+        const auto& ta = colliders.transforms[a];
+        const auto& tb = colliders.transforms[b];
+        entry.manifold.refresh(ta, tb);
+        // a separated pair keeps the points refresh left, they are at most match_distance apart and
+        // let a resting contact that gjk sees as barely touching keep its impulses
+        CollisionInfo contacts[Internal::max_clip_points];
+        const auto parts_a = this->num_parts(a);
+        const auto parts_b = this->num_parts(b);
+        if (parts_a == 1 && parts_b == 1) {
+            const auto num_contacts = this->collide_parts(a, b, entry.hint, entry.axis, contacts);
+            for (auto i = 0; i < num_contacts; ++i) {
+                entry.manifold.add(contacts[i], ta, tb);
+            }
+            return;
+        }
 
-            state.dyn.angular_vel += inv_inertia_tensor * state.dyn.torque_accum;
-            state.dyn.rot = glm::normalize(state.dyn.rot + 0.5f * glm::quat(0.0f, state.dyn.angular_vel) * state.dyn.rot * dt);
+        // decomposed meshes test every pair of parts whose bounds overlap. the manifold has a single
+        // normal, the deepest part pair is added last so that its normal is the one that stays
+        CollisionInfo deepest[Internal::max_clip_points];
+        auto num_deepest = 0;
+        auto deepest_depth = -max_f;
+        for (uint32_t pa = 0; pa < parts_a; ++pa) {
+            const auto bounds_a = this->part_bounds(a, pa);
+            for (uint32_t pb = 0; pb < parts_b; ++pb) {
+                if (!bounds_a.intersect(this->part_bounds(b, pb))) { continue; }
+
+                SupportHint hint{0, 0, pa, pb};
+                auto axis = entry.axis;
+                const auto num_contacts = this->collide_parts(a, b, hint, axis, contacts);
+                if (num_contacts == 0) { continue; }
+
+                auto depth = -max_f;
+                for (auto i = 0; i < num_contacts; ++i) {
+                    depth = Math::max(depth, contacts[i].penetration_depth);
+                }
+                if (depth > deepest_depth) {
+                    for (auto i = 0; i < num_deepest; ++i) {
+                        entry.manifold.add(deepest[i], ta, tb);
+                    }
+                    std::copy_n(contacts, num_contacts, deepest);
+                    num_deepest = num_contacts;
+                    deepest_depth = depth;
+                    entry.axis = axis;
+                }
+                else {
+                    for (auto i = 0; i < num_contacts; ++i) {
+                        entry.manifold.add(contacts[i], ta, tb);
+                    }
+                }
+            }
+        }
+        for (auto i = 0; i < num_deepest; ++i) {
+            entry.manifold.add(deepest[i], ta, tb);
+        }
+    }
 
-            state.dyn.impulse_accum = glm::vec3(0);
-            state.dyn.torque_accum = glm::vec3(0);
+    // every pair only updates its own manifold, the manifolds are gathered in pair order
+    // afterwards so the solver sees the same contacts in the same order on any thread count
+    void World::narrowphase() {
+        const auto num_pairs = this->m_aabb_collisions.size();
+
+        // entries are looked up serially, inserting into the cache is not thread safe
+        ++this->m_step_count;
+        this->m_pair_entries.resize(num_pairs);
+        for (std::size_t k = 0; k < num_pairs; ++k) {
+            const auto [a, b] = this->m_aabb_collisions[k];
+            this->m_pair_entries[k] = &this->m_pair_cache.get(a, b, this->m_step_count);
+        }
 
-            colliders_.transforms[i] = glm::translate(state.dyn.pos) * glm::mat4_cast(state.dyn.rot) * glm::scale(glm::vec3(state.scale));
+        const auto num_threads = s_narrowphase_threads != nullptr ? Core::CVarReadInt(s_narrowphase_threads) : 0;
+        if (num_threads == 1 || num_pairs < Internal::parallel_narrowphase_min_pairs) {
+            for (std::size_t k = 0; k < num_pairs; ++k) {
+                this->narrowphase_pair(k);
+            }
         }
+        else {
+            Core::JobSystem::Get().ParallelFor(
+                num_pairs, Internal::narrowphase_batch_size, [this](const std::size_t begin, const std::size_t end) {
+                    for (auto k = begin; k < end; ++k) {
+                        this->narrowphase_pair(k);
+                    }
+                }, static_cast<uint>(Math::max(num_threads, 0))
+                );
+        }
+
+        this->m_collisions_to_solve.clear();
+        this->m_contact_points.clear();
+        for (std::size_t k = 0; k < num_pairs; ++k) {
+            const auto [a, b] = this->m_aabb_collisions[k];
+            if (!this->m_colliders.is_awake[a] && !this->m_colliders.is_awake[b]) {
+                continue;
+            }
+            auto& manifold = this->m_pair_entries[k]->manifold;
+            for (auto i = 0; i < manifold.num_points; ++i) {
+                auto& p = manifold.points[i];
+                CollisionInfo ci;
+                ci.contact_point_a = p.world_a;
+                ci.contact_point_b = p.world_b;
+                ci.contact_point = 0.5f * (p.world_a + p.world_b);
+                ci.normal = manifold.normal;
+                ci.penetration_depth = p.depth;
+                ci.has_collision = true;
+                ci.a_index = a;
+                ci.b_index = b;
+                this->m_collisions_to_solve.push_back(ci);
+                this->m_contact_points.push_back(&p);
+            }
+        }
+        this->m_pair_cache.evict(this->m_step_count);
+    }
 
-        update_aabbs();
+    void World::step_fixed(const float dt) {
+        auto& colliders = this->m_colliders;
+        auto lap_start = std::chrono::steady_clock::now();
+        // adds the time since the previous lap to the phase
+        const auto lap = [&lap_start](double& phase) {
+            const auto now = std::chrono::steady_clock::now();
+            phase += std::chrono::duration<double>(now - lap_start).count();
+            lap_start = now;
+        };
+
+        // forces first, contacts are then solved against the velocities the bodies would move with
+        integrate_forces(colliders, this->m_awake_bodies, dt);
+        lap(this->m_step_timings.integrate_forces);
 
-        for (std::size_t i = 0; i < get_colliders().states.size(); ++i) {
-            add_center_impulse(ColliderId(i), gravity);
+        const auto ccd = s_ccd == nullptr || Core::CVarReadInt(s_ccd) != 0;
+        if (ccd) {
+            this->m_continuous_collision.sweep(*this, this->m_awake_bodies, dt);
         }
+        lap(this->m_step_timings.ccd);
 
-        sort_and_sweep(aabb_collisions);
-        collisions_to_solve.clear();
-        for (const auto& [a, b]: aabb_collisions) {
-            if (gjk(a, b, saved_simplex)) {
-                if (const auto ci = epa(saved_simplex, a, b);
-                    ci.has_collision) {
-                    collisions_to_solve.push_back(ci);
+        if (s_broadphase != nullptr && Core::CVarReadInt(s_broadphase) == 1) {
+            // a slow body only finds a fast one if the tree holds its swept box
+            if (ccd) {
+                for (const auto i : this->m_continuous_collision.fast_bodies()) {
+                    this->m_aabb_tree.update(i, colliders.aabbs[i]);
                 }
             }
+            this->m_aabb_tree.find_pairs(
+                colliders.aabbs, this->m_awake_bodies, colliders.is_awake, colliders.masks, colliders.filters,
+                this->m_aabb_collisions
+                );
+        }
+        else {
+            this->sort_and_sweep(this->m_aabb_collisions);
+        }
+        lap(this->m_step_timings.broadphase);
+        this->narrowphase();
+        lap(this->m_step_timings.narrowphase);
+
+        // touching an awake body wakes the sleeping island on the other side. a kinematic body is only
+        // woken by giving it a velocity, otherwise what rests on it would keep it from ever sleeping
+        for (const auto& ci : this->m_collisions_to_solve) {
+            if (colliders.states[ci.a_index].inv_mass > 0.0f) { this->wake_island(ci.a_index); }
+            if (colliders.states[ci.b_index].inv_mass > 0.0f) { this->wake_island(ci.b_index); }
         }
 
+        const auto iterations = s_solver_iterations != nullptr ? Core::CVarReadInt(s_solver_iterations) : 10;
+        this->m_contact_solver.prepare(this->m_collisions_to_solve, this->m_contact_points, colliders, dt);
+        this->m_contact_solver.warm_start();
+        for (auto it = 0; it < iterations; ++it) {
+            this->m_contact_solver.solve();
+        }
+        this->m_contact_solver.finish(colliders);
+        lap(this->m_step_timings.solver);
+
+        integrate_motion(colliders, this->m_meshes.simple, this->m_awake_bodies, dt);
+        lap(this->m_step_timings.integrate_motion);
+        if (ccd) {
+            this->m_continuous_collision.clamp(*this, this->m_aabb_collisions, dt);
+        }
+        lap(this->m_step_timings.ccd);
+        for (const auto i : this->m_awake_bodies) {
+            this->m_aabb_tree.update(i, colliders.aabbs[i]);
+        }
+        lap(this->m_step_timings.broadphase);
 
-        for (const auto& ci : collisions_to_solve) {
-            collision_solver(ci, ci.a_id, ci.b_id, dt);
+        if (s_allow_sleep == nullptr || Core::CVarReadInt(s_allow_sleep) != 0) {
+            this->update_islands();
         }
+        lap(this->m_step_timings.islands);
+        ++this->m_step_timings.steps;
     }
 
-    void update_aabbs() {
-        for (std::size_t i = 0; i < colliders_.aabbs.size(); ++i) {
-            const auto cmid = colliders_.meshes[i];
-            auto& aabb = colliders_.aabbs[i];
-            aabb = rotate_aabb_affine(get_collider_meshes().simple[cmid.index], colliders_.transforms[i]);
+    // blends the awake bodies between their last two fixed steps, sleeping ones sit still anyway
+    void World::interpolate_transforms(const float alpha) {
+        auto& colliders = this->m_colliders;
+        for (const auto i : colliders.dynamic_bodies) {
+            if (!colliders.is_awake[i]) {
+                colliders.render_transforms[i] = colliders.transforms[i];
+                continue;
+            }
+            const auto pos = glm::mix(colliders.prev_positions[i], colliders.dynamics.pos[i], alpha);
+            const auto rot = glm::slerp(colliders.prev_rotations[i], colliders.dynamics.rot[i], alpha);
+            colliders.render_transforms[i] = glm::translate(pos) * glm::mat4_cast(rot) * glm::scale(colliders.states[i].scale);
         }
     }
 
-    void sort_and_sweep(std::vector<AABBPair>& aabb_pairs) {
-        aabb_pairs.clear();
-        std::vector<uint32_t> indices(colliders_.aabbs.size());
-        for (uint32_t i = 0; i < indices.size(); ++i) { indices[i] = i; }
+    void World::step(const float dt) {
+        this->m_time_acc += dt;
+        auto num_steps = 0;
+        while (this->m_time_acc >= fixed_step && num_steps < max_substeps) {
+            this->step_fixed(fixed_step);
+            this->m_time_acc -= fixed_step;
+            ++num_steps;
+        }
+        // a frame longer than max_substeps steps loses the rest, carrying it over would only make the
+        // following frames fall behind as well
+        if (this->m_time_acc >= fixed_step) {
+            this->m_time_acc = std::fmod(this->m_time_acc, fixed_step);
+        }
+        this->interpolate_transforms(this->m_time_acc / fixed_step);
+    }
 
-        std::ranges::sort(
-            indices,
-            [&](const uint32_t a, const uint32_t b)-> bool {
-                const auto min_a = colliders_.aabbs[a].min_bound[sort_axis];
-                const auto min_b = colliders_.aabbs[b].min_bound[sort_axis];
-                return min_a < min_b;
+    void World::advance(const uint32_t num_steps) {
+        for (uint32_t i = 0; i < num_steps; ++i) {
+            this->step_fixed(fixed_step);
+        }
+        this->interpolate_transforms(1.0f);
+    }
+
+    namespace Internal {
+
+        constexpr uint32_t snapshot_magic = 0x504E5350; // "PSNP"
+        constexpr uint32_t snapshot_version = 1;
+
+        struct SnapshotWriter {
+            std::vector<uint8_t>& blob;
+
+            void bytes(const void* data, const std::size_t size) {
+                const auto p = static_cast<const uint8_t*>(data);
+                this->blob.insert(this->blob.end(), p, p + size);
             }
-            );
 
-        auto sum = glm::vec3(0), sum2 = glm::vec3(0);
-        glm::vec3 v;
-        for (std::size_t ii = 0; ii < indices.size(); ++ii) {
-            const auto i = indices[ii];
-            const auto a = colliders_.aabbs[i];
-            const auto a_mask = colliders_.masks[i];
-            const auto point = 0.5f * (a.min_bound + a.max_bound);
-            sum += point;
-            sum2 += point * point;
-
-            for (std::size_t jj = ii + 1; jj < indices.size(); ++jj) {
-                const auto j = indices[jj];
-                const auto b = colliders_.aabbs[j];
-                const auto b_mask = colliders_.masks[i];
-                if (a_mask == CollisionMask::None || (a_mask & CollisionMask::Physics) != 0)
-                if (b.min_bound[sort_axis] > a.max_bound[sort_axis]) {
-                    break;
+            template <typename T>
+            void value(const T& v) {
+                static_assert(std::is_trivially_copyable_v<T>);
+                bytes(&v, sizeof(T));
+            }
+
+            template <typename T>
+            void array(const std::vector<T>& v) {
+                static_assert(std::is_trivially_copyable_v<T>);
+                value(static_cast<uint32_t>(v.size()));
+                bytes(v.data(), v.size() * sizeof(T));
+            }
+        };
+
+        // every read past the end or count that doesn't fit the blob clears ok, later reads are no-ops
+        struct SnapshotReader {
+            const std::vector<uint8_t>& blob;
+            std::size_t offset = 0;
+            bool ok = true;
+
+            void bytes(void* data, const std::size_t size) {
+                if (!this->ok || this->blob.size() - this->offset < size) {
+                    this->ok = false;
+                    return;
                 }
-                if (a.intersect(b)) {
-                    aabb_pairs.emplace_back(AABBPair{ColliderId(i), ColliderId(j)});
+                std::memcpy(data, this->blob.data() + this->offset, size);
+                this->offset += size;
+            }
+
+            template <typename T>
+            T value() {
+                T v{};
+                bytes(&v, sizeof(T));
+                return v;
+            }
+
+            template <typename T>
+            void array(std::vector<T>& v) {
+                const auto n = value<uint32_t>();
+                if (!this->ok || (this->blob.size() - this->offset) / sizeof(T) < n) {
+                    this->ok = false;
+                    return;
                 }
+                v.resize(n);
+                bytes(v.data(), n * sizeof(T));
             }
+        };
 
-            v = sum2 - sum * sum / static_cast<float>(indices.size());
-            sort_axis = 0;
-            if (v.y > v.x) sort_axis = 1;
-            if (v.z > v.y) sort_axis = 2;
+        // arrays in the order they are written, the ones that can be derived from them are left out
+        template <typename Stream, typename C>
+        void snapshot_arrays(Stream& stream, C& c) {
+            stream.array(c.ids);
+            stream.array(c.meshes);
+            stream.array(c.shapes);
+            stream.array(c.transforms);
+            stream.array(c.prev_positions);
+            stream.array(c.prev_rotations);
+            stream.array(c.states);
+            stream.array(c.dynamics.pos);
+            stream.array(c.dynamics.vel);
+            stream.array(c.dynamics.rot);
+            stream.array(c.dynamics.angular_vel);
+            stream.array(c.dynamics.impulse_accum);
+            stream.array(c.dynamics.torque_accum);
+            stream.array(c.masks);
+            stream.array(c.is_static);
+            stream.array(c.is_awake);
+            stream.array(c.sleep_timers);
+            stream.array(c.island_links);
+            stream.array(c.dynamic_bodies);
+            stream.array(c.static_bodies);
         }
-    }
 
-    SupportPoint support(const ColliderId a_id, const ColliderId b_id, const glm::vec3& dir) {
-        const auto& collider_a = get_collider_meshes().complex[colliders_.meshes[a_id.index].index];
-        const auto& collider_b = get_collider_meshes().complex[colliders_.meshes[b_id.index].index];
-        const auto& transform_a = colliders_.transforms[a_id.index];
-        const auto& transform_b = colliders_.transforms[b_id.index];
-        const auto a = collider_a.furthest_along(transform_a, dir);
-        const auto b = collider_b.furthest_along(transform_b, -dir);
-        return { a - b, a, b };
     }
 
-    bool gjk(const ColliderId a_id, const ColliderId b_id, Simplex& out_simplex) {
-        auto s = support(a_id, b_id, glm::vec3(1, 0, 0));
-        out_simplex = {};
-        out_simplex.add_point(s);
-        auto dir = -s.point;
-        for (;;) {
-        // for (auto i = 0; i < 64; ++i) {
-            s = support(a_id, b_id, dir);
-            out_simplex.add_point(s);
-            if (glm::dot(out_simplex[0].point, dir) < 0.0f) { return false; }
-            if (next_simplex(out_simplex, dir)) { return true; }
+    std::vector<uint8_t> World::snapshot() const {
+        std::vector<uint8_t> blob;
+        Internal::SnapshotWriter out{blob};
+        out.value(Internal::snapshot_magic);
+        out.value(Internal::snapshot_version);
+        Internal::snapshot_arrays(out, this->m_colliders);
+        out.array(this->m_awake_bodies);
+
+        out.array(this->m_collider_id_pool.generations);
+        std::vector<uint32_t> free_ids;
+        for (auto q = this->m_collider_id_pool.freeIds; !q.empty(); q.pop()) {
+            free_ids.push_back(q.front());
         }
-        return false;
+        out.array(free_ids);
+
+        out.value(this->m_layer_matrix);
+        out.value(this->m_time_acc);
+        out.value(this->m_step_count);
+
+        // sorted so that equal states give equal blobs whatever order the map holds them in
+        std::vector<std::pair<uint64_t, const PairCacheEntry*>> entries;
+        for (const auto& [key, entry] : this->m_pair_cache.entries()) {
+            entries.emplace_back(key, &entry);
+        }
+        std::ranges::sort(entries, {}, &std::pair<uint64_t, const PairCacheEntry*>::first);
+        out.value(static_cast<uint32_t>(entries.size()));
+        for (const auto& [key, entry] : entries) {
+            out.value(key);
+            out.value(*entry);
+        }
+        return blob;
     }
 
-    struct Face {
-        union {
-            SupportPoint v[3];
-            struct {
-                SupportPoint v0, v1, v2;
-            };
+    bool World::restore(const std::vector<uint8_t>& blob) {
+        Internal::SnapshotReader in{blob};
+        if (in.value<uint32_t>() != Internal::snapshot_magic || in.value<uint32_t>() != Internal::snapshot_version) {
+            return false;
+        }
+
+        Colliders c;
+        std::vector<uint32_t> awake;
+        std::vector<uint16_t> generations;
+        std::vector<uint32_t> free_ids;
+        Internal::snapshot_arrays(in, c);
+        in.array(awake);
+        in.array(generations);
+        in.array(free_ids);
+        const auto matrix = in.value<std::array<uint16_t, 16>>();
+        const auto acc = in.value<float>();
+        const auto steps = in.value<uint32_t>();
+        std::vector<std::pair<uint64_t, PairCacheEntry>> entries;
+        for (auto k = in.value<uint32_t>(); in.ok && k > 0; --k) {
+            const auto key = in.value<uint64_t>();
+            entries.emplace_back(key, in.value<PairCacheEntry>());
+        }
+        if (!in.ok || in.offset != blob.size()) { return false; }
+
+        // everything indexed by collider has to be in range before the blob replaces the current state
+        const auto n = c.ids.size();
+        const auto& meshes = this->m_meshes;
+        const auto sized = [n](const auto& v) { return v.size() == n; };
+        const auto in_range = [n](const std::vector<uint32_t>& v) {
+            return std::ranges::all_of(v, [n](const uint32_t i) { return i < n; });
         };
-        glm::vec3 normal;
-    };
-
-    struct Edge {
-        union {
-            SupportPoint v[2];
-            struct {
-                SupportPoint v0, v1;
-            };
+        if (!sized(c.meshes) || !sized(c.shapes) || !sized(c.transforms) || !sized(c.prev_positions) ||
+            !sized(c.prev_rotations) || !sized(c.states) || !sized(c.dynamics.pos) || !sized(c.dynamics.vel) ||
+            !sized(c.dynamics.rot) || !sized(c.dynamics.angular_vel) || !sized(c.dynamics.impulse_accum) ||
+            !sized(c.dynamics.torque_accum) || !sized(c.masks) || !sized(c.is_static) || !sized(c.is_awake) ||
+            !sized(c.sleep_timers) || !sized(c.island_links) || c.dynamic_bodies.size() + c.static_bodies.size() != n ||
+            !in_range(c.island_links) || !in_range(c.dynamic_bodies) || !in_range(c.static_bodies) || !in_range(awake)) {
+            return false;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            if (c.meshes[i].index >= meshes.complex.size() || c.shapes[i] > ShapeType::Custom ||
+                c.ids[i].index >= generations.size() || c.ids[i].generation != generations[c.ids[i].index]) {
+                return false;
+            }
+        }
+        if (std::ranges::any_of(free_ids, [&generations](const uint32_t i) { return i >= generations.size(); })) {
+            return false;
+        }
+
+        // waking and destroying follow island_links until they are back where they started, that only
+        // ends if every body is linked to exactly once
+        std::vector<uint8_t> seen(n, 0);
+        const auto once = [&seen](const uint32_t i) { return std::exchange(seen[i], uint8_t{1}) == 0; };
+        if (!std::ranges::all_of(c.island_links, once)) { return false; }
+        // the partitions hold every body once on the side is_static puts it, and awake every awake dynamic
+        // body once. awake keeps its order, the tree broadphase reports its pairs in that order
+        seen.assign(n, 0);
+        if (!std::ranges::all_of(c.dynamic_bodies, [&](const uint32_t i) { return !c.is_static[i] && once(i); }) ||
+            !std::ranges::all_of(c.static_bodies, [&](const uint32_t i) { return c.is_static[i] && once(i); })) {
+            return false;
+        }
+        seen.assign(n, 0);
+        const auto num_awake = static_cast<std::size_t>(std::ranges::count_if(c.is_awake, [](const uint8_t a) { return a != 0; }));
+        if (awake.size() != num_awake ||
+            !std::ranges::all_of(awake, [&](const uint32_t i) { return c.is_awake[i] && !c.is_static[i] && once(i); })) {
+            return false;
+        }
+        // every handle points at one slot and a free id is not handed out while it is still in use
+        seen.assign(generations.size(), 0);
+        if (!std::ranges::all_of(c.ids, [&once](const ColliderId id) { return once(id.index); }) ||
+            !std::ranges::all_of(free_ids, once)) {
+            return false;
+        }
+        // the cached pairs index the points of their manifold and the hulls of both bodies
+        const auto num_parts = [&](const uint32_t i) {
+            return c.shapes[i] == ShapeType::Custom ? meshes.complex[c.meshes[i].index].hulls.size() : 1;
         };
-    };
+        for (const auto& [key, entry] : entries) {
+            const auto lo = static_cast<uint32_t>(key >> 32);
+            const auto hi = static_cast<uint32_t>(key);
+            if (lo >= hi || hi >= n || entry.manifold.num_points < 0 ||
+                entry.manifold.num_points > ContactManifold::max_points ||
+                entry.hint.part_a >= num_parts(lo) || entry.hint.part_b >= num_parts(hi)) {
+                return false;
+            }
+        }
 
-    std::pair<std::vector<glm::vec4>, std::size_t> get_face_normals(
-        const std::vector<SupportPoint>& polytope, const std::vector<std::size_t>& faces
-        ) {
-        std::vector<glm::vec4> normals;
-        auto min_triangle{0ull};
-        auto min_distance{max_f};
+        // the derived arrays are rebuilt from the restored ones
+        this->m_layer_matrix = matrix;
+        c.indices.assign(generations.size(), 0);
+        for (uint32_t i = 0; i < n; ++i) {
+            c.indices[c.ids[i].index] = i;
+            c.aabbs.push_back(rotate_aabb_affine(meshes.simple[c.meshes[i].index], c.transforms[i]));
+            c.render_transforms.push_back(c.transforms[i]);
+            c.filters.push_back(this->colliding_layers(c.masks[i]));
+        }
+        this->m_colliders = std::move(c);
+        this->m_awake_bodies = std::move(awake);
+        this->m_collider_id_pool.generations = std::move(generations);
+        this->m_collider_id_pool.freeIds = {};
+        for (const auto i : free_ids) {
+            this->m_collider_id_pool.freeIds.push(i);
+        }
+        this->m_time_acc = acc;
+        this->m_step_count = steps;
 
-        for (size_t i = 0; i < faces.size(); i += 3) {
-            const auto a = polytope[faces[i + 0]].point;
-            const auto b = polytope[faces[i + 1]].point;
-            const auto c = polytope[faces[i + 2]].point;
+        this->m_pair_cache.clear();
+        for (const auto& [key, entry] : entries) {
+            this->m_pair_cache.set(key, entry);
+        }
+        this->m_aabb_collisions.clear();
+        this->m_sweep_and_prune.clear();
+        this->m_aabb_tree.clear();
+        for (uint32_t i = 0; i < n; ++i) {
+            this->m_aabb_tree.update(i, this->m_colliders.aabbs[i]);
+        }
+        this->select_triangle(HitInfo());
+        this->interpolate_transforms(this->m_time_acc / fixed_step);
+        return true;
+    }
 
-            auto normal = glm::normalize(cross(b - a, c - a));
-            float distance = glm::dot(normal, a);
+    void World::update_aabbs() {
+        auto& colliders = this->m_colliders;
+        for (const auto i : this->m_awake_bodies) {
+            const auto cmid = colliders.meshes[i];
+            auto& aabb = colliders.aabbs[i];
+            aabb = rotate_aabb_affine(this->m_meshes.simple[cmid.index], colliders.transforms[i]);
+            this->m_aabb_tree.update(i, aabb);
+        }
+    }
 
-            if (distance < 0) {
-                normal *= -1;
-                distance *= -1;
+    void World::sort_and_sweep(std::vector<AABBPair>& aabb_pairs) {
+        auto& colliders = this->m_colliders;
+        this->m_sweep_and_prune.update(
+            colliders.aabbs, colliders.dynamic_bodies, colliders.static_bodies, colliders.masks, colliders.filters
+            );
+        aabb_pairs = this->m_sweep_and_prune.pairs();
+    }
+
+    namespace Internal {
+
+        // orders the feature counter clockwise around n
+        void sort_feature(glm::vec3* points, const int n, const glm::vec3& normal) {
+            glm::vec3 center(0);
+            for (auto i = 0; i < n; ++i) {
+                center += points[i];
             }
+            center /= static_cast<float>(n);
+
+            const auto t1 = Math::safe_normal(glm::cross(normal, glm::abs(normal.x) < 0.57735f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0)));
+            const auto t2 = glm::cross(normal, t1);
+            std::sort(points, points + n, [&](const glm::vec3& p, const glm::vec3& q) {
+                return std::atan2(glm::dot(p - center, t2), glm::dot(p - center, t1)) <
+                       std::atan2(glm::dot(q - center, t2), glm::dot(q - center, t1));
+            });
+        }
 
-            normals.emplace_back(normal, distance);
+        // area weighted normal of a feature ordered by Internal::sort_feature, facing the same way as the sort normal
+        glm::vec3 feature_normal(const glm::vec3* points, const int n) {
+            glm::vec3 normal(0);
+            for (auto i = 0; i < n; ++i) {
+                normal += glm::cross(points[i], points[(i + 1) % n]);
+            }
+            return Math::safe_normal(normal);
+        }
+
+    }
+
+    // boxes and spheres are a single part, custom shapes have one per convex hull of their mesh
+    uint32_t World::num_parts(const uint32_t index) const {
+        if (this->m_colliders.shapes[index] != ShapeType::Custom) { return 1; }
+        return static_cast<uint32_t>(this->m_meshes.complex[this->m_colliders.meshes[index].index].hulls.size());
+    }
+
+    AABB World::part_bounds(const uint32_t index, const uint32_t part, const glm::vec3& offset) const {
+        const auto& colliders = this->m_colliders;
+        auto bounds = colliders.aabbs[index];
+        if (colliders.shapes[index] == ShapeType::Custom) {
+            const auto& hull = this->m_meshes.complex[colliders.meshes[index].index].hulls[part];
+            AABB hull_bounds;
+            hull_bounds.grow(hull.min_bound);
+            hull_bounds.grow(hull.max_bound);
+            bounds = rotate_aabb_affine(hull_bounds, colliders.transforms[index]);
+        }
+        bounds.min_bound += offset;
+        bounds.max_bound += offset;
+        return bounds;
+    }
+
+    // the direction is moved into model space once, the support of an affine transformed
+    // shape along d is the transformed support of the shape along transpose(m) * d
+    glm::vec3 World::furthest_along(const uint32_t index, const uint32_t part, const glm::vec3& dir, uint32_t& hint) const {
+        const auto& colliders = this->m_colliders;
+        const auto& t = colliders.transforms[index];
+        const auto local_dir = glm::transpose(glm::mat3(t)) * dir;
+        const auto cmid = colliders.meshes[index].index;
+
+        glm::vec3 local_point;
+        switch (colliders.shapes[index]) {
+        case ShapeType::Box: {
+            const auto& aabb = this->m_meshes.simple[cmid];
+            local_point = glm::mix(aabb.min_bound, aabb.max_bound, glm::greaterThanEqual(local_dir, glm::vec3(0)));
+            break;
+        }
+        case ShapeType::Sphere: {
+            const auto& aabb = this->m_meshes.simple[cmid];
+            const auto extent = aabb.max_bound - aabb.min_bound;
+            const auto radius = 0.5f * Math::max(extent.x, extent.y, extent.z);
+            local_point = 0.5f * (aabb.min_bound + aabb.max_bound) + radius * Math::safe_normal(local_dir);
+            break;
+        }
+        default:
+            local_point = this->m_meshes.complex[cmid].hulls[part].furthest_along(local_dir, hint);
+            break;
+        }
+        return glm::vec3(t * glm::vec4(local_point, 1.0f));
+    }
 
-            if (distance < min_distance) {
-                min_triangle = i / 3;
-                min_distance = distance;
+    // world space vertices within a thin band below the support plane along dir, the face, edge
+    // or vertex the shape touches with, none for shapes without flat features
+    int World::support_feature(const uint32_t index, const uint32_t part, const glm::vec3& dir, glm::vec3* out) const {
+        const auto& colliders = this->m_colliders;
+        // band width relative to the extent of the shape along dir
+        constexpr auto feature_band = 0.05f;
+
+        const auto& t = colliders.transforms[index];
+        const auto cmid = colliders.meshes[index].index;
+
+        glm::vec3 corners[8];
+        const glm::vec3* vertices = nullptr;
+        std::size_t num_vertices = 0;
+        switch (colliders.shapes[index]) {
+        case ShapeType::Box: {
+            const auto& aabb = this->m_meshes.simple[cmid];
+            for (auto i = 0; i < 8; ++i) {
+                corners[i] = glm::mix(aabb.min_bound, aabb.max_bound, glm::bvec3(i & 1, i & 2, i & 4));
             }
+            vertices = corners;
+            num_vertices = 8;
+            break;
+        }
+        case ShapeType::Sphere:
+            return 0;
+        default: {
+            const auto& hull = this->m_meshes.complex[cmid].hulls[part];
+            vertices = hull.vertices.data();
+            num_vertices = hull.vertices.size();
+            break;
+        }
+        }
+
+        auto lo = max_f;
+        auto hi = -max_f;
+        for (std::size_t i = 0; i < num_vertices; ++i) {
+            const auto d = glm::dot(glm::vec3(t * glm::vec4(vertices[i], 1.0f)), dir);
+            lo = Math::min(lo, d);
+            hi = Math::max(hi, d);
         }
 
-        return {normals, min_triangle};
+        const auto band = feature_band * (hi - lo);
+        auto n = 0;
+        for (std::size_t i = 0; i < num_vertices; ++i) {
+            const auto p = glm::vec3(t * glm::vec4(vertices[i], 1.0f));
+            if (glm::dot(p, dir) < hi - band) {
+                continue;
+            }
+            if (n == Internal::max_feature_points) {
+                return 0;
+            }
+            out[n++] = p;
+        }
+        return n;
     }
 
-    void add_if_unique(
-        std::vector<std::pair<std::size_t, std::size_t>>& edges, const std::vector<std::size_t>& faces,
-        const std::size_t a, const std::size_t b
-        ) {
-        const auto reverse = std::ranges::find(
-            edges,
-            std::make_pair(faces[b], faces[a])
-            );
+    // clips the touching feature of one shape against the touching face of the other, every
+    // point of the overlap becomes a contact with its own depth below the reference face
+    int World::clip_contacts(const CollisionInfo& ci, const SupportHint& hint, CollisionInfo* out) const {
+        const auto n = ci.normal;
+        glm::vec3 feature_a[Internal::max_feature_points];
+        glm::vec3 feature_b[Internal::max_feature_points];
+        const auto num_a = this->support_feature(ci.a_index, hint.part_a, -n, feature_a);
+        const auto num_b = this->support_feature(ci.b_index, hint.part_b, n, feature_b);
+
+        // edge against edge or vertex contacts have nothing to clip against
+        if (num_a == 0 || num_b == 0 || (num_a < 3 && num_b < 3)) {
+            return 0;
+        }
+        if (num_a >= 3) { Internal::sort_feature(feature_a, num_a, n); }
+        if (num_b >= 3) { Internal::sort_feature(feature_b, num_b, n); }
+
+        // the face closest to the epa normal is the reference, measuring every depth against its
+        // normal keeps them consistent when the bodies are tilted against each other
+        const auto normal_a = num_a >= 3 ? Internal::feature_normal(feature_a, num_a) : glm::vec3(0);
+        const auto normal_b = num_b >= 3 ? Internal::feature_normal(feature_b, num_b) : glm::vec3(0);
+        const auto reference_is_a = glm::dot(normal_a, n) >= glm::dot(normal_b, n);
+        const auto face_normal = reference_is_a ? normal_a : normal_b;
+        const auto* reference = reference_is_a ? feature_a : feature_b;
+        const auto num_reference = reference_is_a ? num_a : num_b;
+
+        glm::vec3 buffers[2][Internal::max_clip_points];
+        auto* polygon = buffers[0];
+        auto* clipped = buffers[1];
+        auto num_polygon = reference_is_a ? num_b : num_a;
+        std::copy_n(reference_is_a ? feature_b : feature_a, num_polygon, polygon);
+
+        for (auto e = 0; e < num_reference && num_polygon > 0; ++e) {
+            const auto r0 = reference[e];
+            const auto edge = reference[(e + 1) % num_reference] - r0;
+            auto num_clipped = 0;
+            for (auto i = 0; i < num_polygon; ++i) {
+                const auto p = polygon[i];
+                const auto q = polygon[(i + 1) % num_polygon];
+                const auto dp = glm::dot(glm::cross(edge, p - r0), face_normal);
+                const auto dq = glm::dot(glm::cross(edge, q - r0), face_normal);
+                if (dp >= 0.0f && num_clipped < Internal::max_clip_points) {
+                    clipped[num_clipped++] = p;
+                }
+                if ((dp < 0.0f) != (dq < 0.0f) && num_clipped < Internal::max_clip_points) {
+                    clipped[num_clipped++] = p + (q - p) * (dp / (dp - dq));
+                }
+            }
+            std::swap(polygon, clipped);
+            num_polygon = num_clipped;
+        }
+
+        glm::vec3 plane(0);
+        for (auto i = 0; i < num_reference; ++i) {
+            plane += reference[i];
+        }
+        plane /= static_cast<float>(num_reference);
+
+        auto num_out = 0;
+        for (auto i = 0; i < num_polygon; ++i) {
+            const auto p = polygon[i];
+            auto& contact = out[num_out];
+            contact = ci;
+            contact.normal = face_normal;
+            if (reference_is_a) {
+                contact.penetration_depth = glm::dot(p - plane, face_normal);
+                contact.contact_point_b = p;
+                contact.contact_point_a = p - contact.penetration_depth * face_normal;
+            }
+            else {
+                contact.penetration_depth = glm::dot(plane - p, face_normal);
+                contact.contact_point_a = p;
+                contact.contact_point_b = p + contact.penetration_depth * face_normal;
+            }
+            contact.contact_point = 0.5f * (contact.contact_point_a + contact.contact_point_b);
+            // points that are a little apart are kept, the solver lets them close the gap
+            if (contact.penetration_depth > -ContactManifold::match_distance) {
+                ++num_out;
+            }
+        }
+        return num_out;
+    }
 
-        if (reverse != edges.end()) { edges.erase(reverse); }
-        else { edges.emplace_back(faces[a], faces[b]); }
+    SupportPoint World::support(
+        const uint32_t a_index, const uint32_t b_index, const glm::vec3& dir, SupportHint& hint, const glm::vec3& offset_a
+        ) const {
+        const auto a = this->furthest_along(a_index, hint.part_a, dir, hint.a) + offset_a;
+        const auto b = this->furthest_along(b_index, hint.part_b, -dir, hint.b);
+        return { a - b, a, b };
     }
 
-    CollisionInfo epa(const Simplex& simplex, ColliderId a_id, ColliderId b_id) {
+    bool World::gjk(
+        const uint32_t a_index, const uint32_t b_index, Simplex& out_simplex, SupportHint& hint, glm::vec3& axis,
+        const glm::vec3& offset_a
+        ) const {
+        // touching faces can make the simplex cycle, such pairs are treated as separated
+        constexpr auto max_iterations = 32;
+
+        auto dir = glm::dot(axis, axis) > epsilon_f ? axis : glm::vec3(1, 0, 0);
+        auto s = this->support(a_index, b_index, dir, hint, offset_a);
+        // a cached axis that still separates the pair ends the test after one support query
+        if (glm::dot(s.point, dir) < 0.0f) {
+            axis = dir;
+            return false;
+        }
+        out_simplex = {};
+        out_simplex.add_point(s);
+        dir = -s.point;
+        for (auto i = 0; i < max_iterations; ++i) {
+            s = this->support(a_index, b_index, dir, hint, offset_a);
+            out_simplex.add_point(s);
+            if (glm::dot(out_simplex[0].point, dir) < 0.0f) {
+                axis = dir;
+                return false;
+            }
+            if (next_simplex(out_simplex, dir)) { return true; }
+        }
+        axis = dir;
+        return false;
+    }
+
+    bool World::overlap(
+        const uint32_t a_index, const uint32_t b_index, SupportHint& hint, glm::vec3& axis, const glm::vec3& offset_a
+        ) const {
+        const auto parts_a = this->num_parts(a_index);
+        const auto parts_b = this->num_parts(b_index);
+        Simplex simplex;
+        if (parts_a == 1 && parts_b == 1) {
+            return this->gjk(a_index, b_index, simplex, hint, axis, offset_a);
+        }
+        for (uint32_t pa = 0; pa < parts_a; ++pa) {
+            const auto bounds_a = this->part_bounds(a_index, pa, offset_a);
+            for (uint32_t pb = 0; pb < parts_b; ++pb) {
+                if (!bounds_a.intersect(this->part_bounds(b_index, pb))) { continue; }
+                SupportHint part_hint{0, 0, pa, pb};
+                auto part_axis = axis;
+                if (this->gjk(a_index, b_index, simplex, part_hint, part_axis, offset_a)) { return true; }
+            }
+        }
+        return false;
+    }
+
+    CollisionInfo World::epa(
+        const Simplex& simplex, const uint32_t a_index, const uint32_t b_index, SupportHint& hint,
+        const glm::vec3& offset_a
+        ) const {
         constexpr auto max_iterations = 64;
-        constexpr auto max_faces = 64;
-        constexpr auto max_edges = 32;
-
-        std::vector<SupportPoint> polytope(simplex.begin(), simplex.end());
-        std::vector<size_t> faces = {
-            0, 1, 2,
-            0, 3, 1,
-            0, 2, 3,
-            1, 3, 2
+        // every iteration adds one point and a convex polytope over n points has at most 2n - 4 faces
+        constexpr auto max_points = 4 + max_iterations;
+        constexpr auto max_faces = 2 * max_points - 4;
+        // each removed face hands in its three edges, shared ones cancel out and leave the horizon
+        constexpr auto max_edges = 3 * max_faces;
+
+        SupportPoint polytope[max_points];
+        std::array<uint8_t, 3> faces[max_faces];
+        glm::vec4 normals[max_faces];
+        std::array<uint8_t, 2> edges[max_edges];
+        bool visible[max_faces];
+        // directed edge (a, b) lives at a * max_points + b
+        std::bitset<max_points * max_points> edge_set;
+
+        auto num_points = 0;
+        auto num_faces = 0;
+        for (const auto& p : simplex) {
+            polytope[num_points++] = p;
+        }
+
+        // faces are wound so their normal points out of the polytope, flipping a normal towards the origin
+        // instead goes wrong once the origin lies almost on a face and leaves a polytope that is not closed
+        const auto p0 = polytope[0].point;
+        if (glm::dot(glm::cross(polytope[1].point - p0, polytope[2].point - p0), polytope[3].point - p0) > 0.0f) {
+            std::swap(polytope[1], polytope[2]);
+        }
+
+        const auto add_face = [&](const uint8_t a, const uint8_t b, const uint8_t c) {
+            faces[num_faces] = {a, b, c};
+            const auto cross = glm::cross(polytope[b].point - polytope[a].point, polytope[c].point - polytope[a].point);
+            // shapes that only just touch leave a flat simplex, its faces have no normal and are never the closest
+            if (glm::dot(cross, cross) <= epsilon_f * epsilon_f) {
+                normals[num_faces] = glm::vec4(cross, max_f);
+                ++num_faces;
+                return;
+            }
+            const auto normal = glm::normalize(cross);
+            normals[num_faces] = glm::vec4(normal, Math::max(0.0f, glm::dot(normal, polytope[a].point)));
+            ++num_faces;
+        };
+        const auto closest_face = [&]() {
+            auto min_face = 0;
+            for (auto f = 1; f < num_faces; ++f) {
+                if (normals[f].w < normals[min_face].w) { min_face = f; }
+            }
+            return min_face;
         };
-        auto [normals, min_face] = get_face_normals(polytope, faces);
-        auto min_norm{glm::vec3{}};
-        auto min_dist{max_f};
-
-        for (auto i{0ull}; min_dist == max_f && i < max_iterations; ++i) {
-            min_norm = glm::xyz(normals[min_face]);
-            min_dist = normals[min_face].w;
-
-            const auto s = support(a_id, b_id, min_norm);
-            auto s_dist{ glm::dot(min_norm, s.point) };
-
-            if (std::abs(s_dist - min_dist) > epsilon_f) {
-                min_dist = max_f;
-                std::vector<std::pair<std::size_t, std::size_t>> unique_edges{};
-                for (auto j{0ull}; j < normals.size(); ++j) {
-                    const auto f{ j * 3 };
-                    if (glm::dot(glm::vec3(normals[j]), s.point) > glm::dot(glm::vec3(normals[j]), polytope[faces[f]].point)) {
-                        add_if_unique(unique_edges, faces, f + 0, f + 1);
-                        add_if_unique(unique_edges, faces, f + 1, f + 2);
-                        add_if_unique(unique_edges, faces, f + 2, f + 0);
-
-                        faces[f + 2] = faces.back();
-                        faces.pop_back();
-                        faces[f + 1] = faces.back();
-                        faces.pop_back();
-                        faces[f + 0] = faces.back();
-                        faces.pop_back();
-
-                        normals[j] = normals.back();
-                        normals.pop_back();
-
-                        j--;
+
+        add_face(0, 1, 2);
+        add_face(0, 3, 1);
+        add_face(0, 2, 3);
+        add_face(1, 3, 2);
+        auto min_face = closest_face();
+
+        for (auto i = 0; i < max_iterations && num_points < max_points && normals[min_face].w != max_f; ++i) {
+            const auto min_norm = glm::vec3(normals[min_face]);
+            const auto s = this->support(a_index, b_index, min_norm, hint, offset_a);
+            if (std::abs(glm::dot(min_norm, s.point) - normals[min_face].w) <= epsilon_f) { break; }
+
+            auto num_edges = 0;
+            auto num_visible = 0;
+            for (auto f = 0; f < num_faces; ++f) {
+                const auto n = glm::vec3(normals[f]);
+                visible[f] = glm::dot(n, s.point) > glm::dot(n, polytope[faces[f][0]].point);
+                if (!visible[f]) { continue; }
+                ++num_visible;
+                for (auto e = 0; e < 3; ++e) {
+                    const auto a = faces[f][e];
+                    const auto b = faces[f][(e + 1) % 3];
+                    if (edge_set.test(b * max_points + a)) {
+                        edge_set.reset(b * max_points + a);
+                    }
+                    else {
+                        edge_set.set(a * max_points + b);
+                        edges[num_edges++] = {a, b};
                     }
                 }
+            }
 
-                std::vector<std::size_t> new_faces{};
-                for (const auto [e1, e2] : unique_edges) {
-                    new_faces.push_back(e1);
-                    new_faces.push_back(e2);
-                    new_faces.push_back(polytope.size());
-                }
+            if (num_visible == 0) { break; }
 
-                polytope.push_back(s);
+            auto num_horizon = 0;
+            for (auto e = 0; e < num_edges; ++e) {
+                num_horizon += edge_set.test(edges[e][0] * max_points + edges[e][1]);
+            }
+            if (num_faces - num_visible + num_horizon > max_faces) {
+                break;
+            }
 
-                const auto [new_normals, new_min_face] = get_face_normals(polytope, new_faces);
-                auto old_min_distance{max_f};
-                for (size_t j = 0; j < normals.size(); j++) {
-                    if (normals[j].w < old_min_distance) {
-                        old_min_distance = normals[j].w;
-                        min_face = j;
-                    }
+            auto write = 0;
+            for (auto f = 0; f < num_faces; ++f) {
+                if (!visible[f]) {
+                    faces[write] = faces[f];
+                    normals[write] = normals[f];
+                    ++write;
                 }
-
-                if (new_normals[new_min_face].w < old_min_distance) {
-                    min_face = new_min_face + normals.size();
+            }
+            num_faces = write;
+
+            const auto new_point = static_cast<uint8_t>(num_points);
+            polytope[num_points++] = s;
+            for (auto e = 0; e < num_edges; ++e) {
+                const auto [a, b] = edges[e];
+                if (edge_set.test(a * max_points + b)) {
+                    edge_set.reset(a * max_points + b);
+                    add_face(a, b, new_point);
                 }
-
-                faces.insert(faces.end(), new_faces.begin(), new_faces.end());
-                normals.insert(normals.end(), new_normals.begin(), new_normals.end());
             }
+            min_face = closest_face();
+        }
+
+        const auto min_norm = glm::vec3(normals[min_face]);
+        const auto min_dist = normals[min_face].w;
+        if (min_dist == max_f) {
+            return {};
         }
 
-        const auto& s0 = polytope[faces[3 * min_face + 0]];
-        const auto& s1 = polytope[faces[3 * min_face + 1]];
-        const auto& s2 = polytope[faces[3 * min_face + 2]];
+        const auto& s0 = polytope[faces[min_face][0]];
+        const auto& s1 = polytope[faces[min_face][1]];
+        const auto& s2 = polytope[faces[min_face][2]];
         const auto a = s0.point;
         const auto b = s1.point;
         const auto c = s2.point;
@@ -561,66 +1644,168 @@ namespace Physics {
         const auto aoac = glm::dot(ao, ac);
 
         const auto denom = abac * abac - abab * acac;
-        const auto s = (abac * aoac - acac * aoab) / denom;
-        const auto t = (abac * aoab - abab * aoac) / denom;
-        const auto r = 1.0f - s - t;
-
+        // coplanar faces of the polytope are equally close, the origin can project outside the one that
+        // was picked, clamping keeps the witness points on the shapes instead of extrapolating
+        auto s = Math::max(0.0f, (abac * aoac - acac * aoab) / denom);
+        auto t = Math::max(0.0f, (abac * aoab - abab * aoac) / denom);
+        auto r = Math::max(0.0f, 1.0f - s - t);
+        const auto sum = r + s + t;
+        s /= sum;
+        t /= sum;
+        r /= sum;
         CollisionInfo ret{};
         ret.contact_point_a = r * s0.a + s * s1.a + t * s2.a;
         ret.contact_point_b = r * s0.b + s * s1.b + t * s2.b;
-        ret.contact_point = 0.5f * (ret.contact_point_a + ret.contact_point_b);
         ret.normal = -min_norm;
         ret.penetration_depth = min_dist;
+
+        // with touching faces the witness points can slide anywhere along their face, a box on a large
+        // floor gets a point on the far end of the floor, so both are moved into the overlap of the shapes
+        const auto lateral = ret.contact_point_a - ret.contact_point_b + min_dist * ret.normal;
+        if (glm::dot(lateral, lateral) > epsilon_f) {
+            const auto u = glm::normalize(lateral);
+            auto hint_a = hint.a;
+            auto hint_b = hint.b;
+            const auto lo = Math::max(
+                glm::dot(this->furthest_along(a_index, hint.part_a, -u, hint_a) + offset_a, u),
+                glm::dot(this->furthest_along(b_index, hint.part_b, -u, hint_b), u)
+                );
+            const auto hi = Math::min(
+                glm::dot(this->furthest_along(a_index, hint.part_a, u, hint_a) + offset_a, u),
+                glm::dot(this->furthest_along(b_index, hint.part_b, u, hint_b), u)
+                );
+            if (lo <= hi) {
+                const auto target = glm::clamp(0.5f * glm::dot(ret.contact_point_a + ret.contact_point_b, u), lo, hi);
+                ret.contact_point_a += (target - glm::dot(ret.contact_point_a, u)) * u;
+                ret.contact_point_b += (target - glm::dot(ret.contact_point_b, u)) * u;
+            }
+        }
+        ret.contact_point = 0.5f * (ret.contact_point_a + ret.contact_point_b);
         ret.has_collision = true;
-        ret.a_id = a_id;
-        ret.b_id = b_id;
+        ret.a_index = a_index;
+        ret.b_index = b_index;
 
         return ret;
     }
 
-    void collision_solver(const CollisionInfo& collision_info, const ColliderId a_id, const ColliderId b_id, const float dt) {
-        constexpr auto rest = 0.6f;
-        constexpr auto bais_factor = 0.25f;
-        constexpr auto slop = 0.001f;
-        auto& a_state = colliders_.states[a_id.index];
-        auto& b_state = colliders_.states[b_id.index];
-        const auto& a_t = colliders_.transforms[a_id.index];
-        const auto& b_t = colliders_.transforms[b_id.index];
-
-        const auto a_r = collision_info.contact_point - glm::vec3(a_t * glm::vec4(a_state.orig, 1.0f));
-        const auto b_r = collision_info.contact_point - glm::vec3(b_t * glm::vec4(b_state.orig, 1.0f));
-
-        const auto a_vel = a_state.dyn.vel + glm::cross(a_state.dyn.angular_vel, a_r);
-        const auto b_vel = b_state.dyn.vel + glm::cross(b_state.dyn.angular_vel, b_r);
-
-        const auto tnorm = collision_info.normal;
-        const auto rel_vel = glm::dot(tnorm, (a_vel - b_vel));
-        if (rel_vel > epsilon_f) return;
-
-        const auto a_rotm = glm::mat3_cast(a_state.dyn.rot);
-        const auto b_rotm = glm::mat3_cast(b_state.dyn.rot);
-        const auto a_inv_inertia = a_rotm * a_state.inv_inertia_shape * glm::transpose(a_rotm);
-        const auto b_inv_inertia = b_rotm * b_state.inv_inertia_shape * glm::transpose(b_rotm);
-        const auto a_rn = glm::cross(a_r, tnorm);
-        const auto b_rn = glm::cross(b_r, tnorm);
-        const auto a_term = a_state.inv_mass + glm::dot(a_rn, a_inv_inertia * a_rn);
-        const auto b_term = b_state.inv_mass + glm::dot(b_rn, b_inv_inertia * b_rn);
-        const auto bais = bais_factor / dt * Math::max(0.0f, collision_info.penetration_depth - slop);
-        const auto a_j = (-(1.0f + rest) * rel_vel + bais) / (a_term + b_term);
-        const auto b_j = -a_j;
-
-        if (a_state.inv_mass != 0.0f) {
-            const auto a_impulse = a_j * tnorm;
-            const auto a_angular_impulse = glm::cross(a_r, a_impulse);
-            a_state.dyn.impulse_accum += a_impulse;
-            a_state.dyn.torque_accum += a_angular_impulse;
-        }
-        if (b_state.inv_mass != 0.0f) {
-            const auto b_impulse = b_j * tnorm;
-            const auto b_angular_impulse = glm::cross(b_r, b_impulse);
-            b_state.dyn.impulse_accum += b_impulse;
-            b_state.dyn.torque_accum += b_angular_impulse;
-        }
+    World& get_world() {
+        static World world;
+        return world;
+    }
+
+    const Colliders& get_colliders() { return get_world().get_colliders(); }
+    Colliders& colliders() { return get_world().colliders(); }
+    ColliderMeshes& get_collider_meshes() { return get_world().collider_meshes(); }
+
+    ColliderMeshId load_collider_mesh(const std::string& filepath) {
+        return get_world().load_collider_mesh(filepath);
+    }
+
+    ColliderId create_rigidbody(
+        const ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const glm::vec3& scale, const float mass, const ShapeType type, const uint16_t mask
+        ) {
+        return get_world().create_rigidbody(cm_id, orig, translation, rotation, scale, mass, type, mask);
+    }
+
+    ColliderId create_rigidbody(
+        const ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const float scale, const float mass, const ShapeType type, const uint16_t mask
+        ) {
+        return get_world().create_rigidbody(cm_id, orig, translation, rotation, scale, mass, type, mask);
+    }
+
+    ColliderId create_staticbody(
+        const ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const glm::vec3& scale, const ShapeType type, const uint16_t mask
+        ) {
+        return get_world().create_staticbody(cm_id, orig, translation, rotation, scale, type, mask);
+    }
+
+    ColliderId create_staticbody(
+        const ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const float scale, const ShapeType type, const uint16_t mask
+        ) {
+        return get_world().create_staticbody(cm_id, orig, translation, rotation, scale, type, mask);
+    }
+
+    ColliderId create_kinematicbody(
+        const ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const glm::vec3& scale, const ShapeType type, const uint16_t mask
+        ) {
+        return get_world().create_kinematicbody(cm_id, orig, translation, rotation, scale, type, mask);
+    }
+
+    ColliderId create_kinematicbody(
+        const ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const float scale, const ShapeType type, const uint16_t mask
+        ) {
+        return get_world().create_kinematicbody(cm_id, orig, translation, rotation, scale, type, mask);
+    }
+
+    void set_transform(const ColliderId collider, const glm::mat4& t) { get_world().set_transform(collider, t); }
+
+    void set_velocity(const ColliderId collider, const glm::vec3& linear, const glm::vec3& angular) {
+        get_world().set_velocity(collider, linear, angular);
+    }
+
+    void destroy_collider(const ColliderId collider) { get_world().destroy_collider(collider); }
+    uint32_t collider_index(const ColliderId collider) { return get_world().collider_index(collider); }
+    bool is_valid(const ColliderId collider) { return get_world().is_valid(collider); }
+    bool is_kinematic(const ColliderId collider) { return get_world().is_kinematic(collider); }
+
+    void set_layer_collision(const uint16_t layers_a, const uint16_t layers_b, const bool collide) {
+        get_world().set_layer_collision(layers_a, layers_b, collide);
+    }
+
+    uint16_t colliding_layers(const uint16_t mask) { return get_world().colliding_layers(mask); }
+    bool should_collide(const uint16_t mask_a, const uint16_t mask_b) { return get_world().should_collide(mask_a, mask_b); }
+
+    bool cast_ray(const Ray& ray, HitInfo& hit, const uint16_t mask) { return get_world().cast_ray(ray, hit, mask); }
+
+    bool cast_ray(const glm::vec3& start, const glm::vec3& dir, HitInfo& hit, const uint16_t mask) {
+        return get_world().cast_ray(start, dir, hit, mask);
+    }
+
+    void select_triangle(const HitInfo& hit) { get_world().select_triangle(hit); }
+
+    bool cast_collider(const ColliderId collider, const glm::vec3& motion, HitInfo& hit) {
+        return get_world().cast_collider(collider, motion, hit);
+    }
+
+    void add_center_impulse(const ColliderId collider, const glm::vec3& dir) {
+        get_world().add_center_impulse(collider, dir);
+    }
+
+    void add_impulse(const ColliderId collider, const glm::vec3& loc, const glm::vec3& dir) {
+        get_world().add_impulse(collider, loc, dir);
+    }
+
+    void wake(const ColliderId collider) { get_world().wake(collider); }
+    bool is_awake(const ColliderId collider) { return get_world().is_awake(collider); }
+    void step(const float dt) { get_world().step(dt); }
+    void advance(const uint32_t num_steps) { get_world().advance(num_steps); }
+    void update_aabbs() { get_world().update_aabbs(); }
+    std::vector<uint8_t> snapshot() { return get_world().snapshot(); }
+    bool restore(const std::vector<uint8_t>& blob) { return get_world().restore(blob); }
+    const StepTimings& get_step_timings() { return get_world().get_step_timings(); }
+    void reset_step_timings() { get_world().reset_step_timings(); }
+    void sort_and_sweep(std::vector<AABBPair>& aabb_pairs) { get_world().sort_and_sweep(aabb_pairs); }
+
+    SupportPoint support(const uint32_t a_index, const uint32_t b_index, const glm::vec3& dir, SupportHint& hint) {
+        return get_world().support(a_index, b_index, dir, hint);
+    }
+
+    bool gjk(const uint32_t a_index, const uint32_t b_index, Simplex& out_simplex, SupportHint& hint, glm::vec3& axis) {
+        return get_world().gjk(a_index, b_index, out_simplex, hint, axis);
+    }
+
+    CollisionInfo epa(const Simplex& simplex, const uint32_t a_index, const uint32_t b_index, SupportHint& hint) {
+        return get_world().epa(simplex, a_index, b_index, hint);
+    }
+
+    bool overlap(const uint32_t a_index, const uint32_t b_index, SupportHint& hint, glm::vec3& axis) {
+        return get_world().overlap(a_index, b_index, hint, axis);
     }
 
 } // namespace Physics
\ No newline at end of file
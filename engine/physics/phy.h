@@ -1,5 +1,14 @@
 ﻿#pragma once
+#include <array>
+
+#include "aabbtree.h"
+#include "broadphase.h"
+#include "ccd.h"
+#include "paircache.h"
+#include "physicsmesh.h"
 #include "physicsresource.h"
+#include "solver.h"
+#include "core/idpool.h"
 
 
 namespace Physics {
@@ -7,9 +16,10 @@ namespace Physics {
     struct Ray;
     struct Simplex;
 
+    // box and sphere use analytic supports over the local aabb of their mesh, custom uses the mesh vertices
     enum class ShapeType : uint8_t {
         Box = 0,
-        // Sphere,
+        Sphere,
         Custom,
     };
 
@@ -23,21 +33,16 @@ namespace Physics {
         };
     }
 
-    struct State {
-        struct Dyn {
-            glm::vec3 pos = glm::vec3(0);
-            glm::vec3 vel = glm::vec3(0);
-            glm::quat rot = glm::quat();
-            glm::vec3 angular_vel = glm::vec3(0);
-            glm::vec3 impulse_accum = glm::vec3(0);
-            glm::vec3 torque_accum = glm::vec3(0);
-
-            Dyn& set_pos(const glm::vec3& p);
-            Dyn& set_vel(const glm::vec3& v);
-            Dyn& set_rot(const glm::quat& r);
-        };
+    // every CollisionMask bit is a layer and the layer matrix says which layers generate contacts with
+    // each other, by default only Physics collides with Physics. the matrix is symmetric and belongs to a
+    // world, changing it applies to every collider of the world including the existing ones
+    void set_layer_collision(uint16_t layers_a, uint16_t layers_b, bool collide);
+    // union of the layers that any layer of mask collides with
+    uint16_t colliding_layers(uint16_t mask);
+    bool should_collide(uint16_t mask_a, uint16_t mask_b);
 
-        Dyn dyn;
+    // mass properties, the motion of the bodies lives in Dynamics
+    struct State {
         glm::mat3 inv_inertia_shape = glm::mat3(0);
         glm::vec3 orig = glm::vec3(0);
         glm::vec3 scale = glm::vec3(1.0f);
@@ -49,58 +54,312 @@ namespace Physics {
         State& set_scale(const glm::vec3& s);
     };
 
-    struct AABB;
+    // motion of every body with each quantity in its own array, the integrator streams through them
+    // eight bodies at a time
+    struct Dynamics {
+        std::vector<glm::vec3> pos;
+        std::vector<glm::vec3> vel;
+        std::vector<glm::quat> rot;
+        std::vector<glm::vec3> angular_vel;
+        std::vector<glm::vec3> impulse_accum;
+        std::vector<glm::vec3> torque_accum;
 
+        void push_back(const glm::vec3& p, const glm::quat& r);
+        // moves the last body into index
+        void remove(uint32_t index);
+    };
+
+    // every array is indexed by the dense collider index, destroying a collider moves the last one into
+    // its slot. ColliderIds stay valid across that, indices maps their index to the current slot and ids
+    // maps back
     struct Colliders {
+        std::vector<ColliderId> ids;
+        std::vector<uint32_t> indices;
         std::vector<ColliderMeshId> meshes;
+        std::vector<ShapeType> shapes;
         std::vector<AABB> aabbs;
         std::vector<glm::mat4> transforms;
+        // pose before the last fixed step and the pose between it and transforms for the current frame,
+        // drawing uses render_transforms so motion stays smooth whatever the frame rate
+        std::vector<glm::vec3> prev_positions;
+        std::vector<glm::quat> prev_rotations;
+        std::vector<glm::mat4> render_transforms;
         std::vector<State> states;
+        Dynamics dynamics;
         std::vector<uint16_t> masks;
+        // colliding_layers of the mask, a pair is only looked at if filters[a] & masks[b]
+        std::vector<uint16_t> filters;
+        // a body in the dynamic partition with an inv_mass of 0 is kinematic, it moves by its velocity
+        // but gravity and contacts don't change that velocity
+        std::vector<uint8_t> is_static;
+        std::vector<uint8_t> is_awake;
+        std::vector<float> sleep_timers;
+        // ring through the bodies of a sleeping island so that waking one wakes all of them
+        std::vector<uint32_t> island_links;
+
+        // body indices split by partition, static bodies are never integrated or refreshed and the
+        // sweep and prune keeps them in endpoint lists of their own
+        std::vector<uint32_t> dynamic_bodies;
+        std::vector<uint32_t> static_bodies;
     };
 
     constexpr auto gravity = glm::vec3(0, -9.81f, 0);
 
+    // the simulation always advances by fixed_step, a frame runs as many steps as its time covers but
+    // at most max_substeps, the time past that is dropped and the simulation slows down instead
+    constexpr auto fixed_step = 1.0f / 60.0f;
+    constexpr auto max_substeps = 4;
+
+    // an island goes to sleep once all of its bodies stayed below these speeds for sleep_time seconds
+    constexpr auto sleep_linear_velocity = 0.05f;
+    constexpr auto sleep_angular_velocity = 0.05f;
+    constexpr auto sleep_time = 0.5f;
+
+    // wall time the fixed steps spent in each phase since the last reset, in seconds
+    struct StepTimings {
+        double integrate_forces = 0.0;
+        double ccd = 0.0;
+        double broadphase = 0.0;
+        double narrowphase = 0.0;
+        double solver = 0.0;
+        double integrate_motion = 0.0;
+        double islands = 0.0;
+        uint32_t steps = 0;
+    };
+
+    // one independent simulation: the colliders and their handles, the meshes they use, the broadphase,
+    // the contact cache and the sleeping islands. worlds share nothing but the cvars and the job pool, so
+    // separate worlds can be stepped on separate threads, and a copy of a world simulates on from where
+    // it was copied without touching the original.
+    // the members work like the free functions of the same name, which use the world from get_world()
+    struct World {
+    private:
+        Util::IdPool<ColliderId> m_collider_id_pool;
+        Colliders m_colliders;
+        ColliderMeshes m_meshes;
+        SweepAndPrune m_sweep_and_prune;
+        AABBTree m_aabb_tree;
+
+        std::vector<AABBPair> m_aabb_collisions;
+        std::vector<CollisionInfo> m_collisions_to_solve;
+        // manifold point of every entry in m_collisions_to_solve, holds the warm start impulses.
+        // this and m_pair_entries point into m_pair_cache and are refilled by every step before they are
+        // read, a copied world doesn't use the pointers it copied
+        std::vector<ContactPoint*> m_contact_points;
+        std::vector<PairCacheEntry*> m_pair_entries;
+        ContactSolver m_contact_solver;
+        ContinuousCollision m_continuous_collision;
+        PairCache m_pair_cache;
+        uint32_t m_step_count = 0;
+        std::vector<uint32_t> m_awake_bodies;
+        std::vector<uint32_t> m_island_roots;
+        std::vector<float> m_island_timers;
+
+        HitInfo m_selected_hit;
+
+        // row i holds the layers that layer 1 << i collides with
+        std::array<uint16_t, 16> m_layer_matrix = {0, CollisionMask::Physics};
+
+        // frame time that hasn't been simulated yet, always less than fixed_step after a step
+        float m_time_acc = 0.0f;
+        StepTimings m_step_timings;
+
+        void wake_island(uint32_t index);
+        void set_partition(uint32_t index, bool is_static);
+        ColliderId push_collider(
+            ColliderMeshId cm_id, ShapeType type, const glm::mat4& mat, const glm::vec3& translation,
+            const glm::quat& rotation, uint16_t mask, const State& state
+            );
+        uint32_t find_island(uint32_t i);
+        void update_islands();
+
+        int collide_parts(uint32_t a, uint32_t b, SupportHint& hint, glm::vec3& axis, CollisionInfo* out) const;
+        void narrowphase_pair(std::size_t k);
+        void narrowphase();
+        void step_fixed(float dt);
+        void interpolate_transforms(float alpha);
+
+        [[nodiscard]] uint32_t num_parts(uint32_t index) const;
+        [[nodiscard]] AABB part_bounds(uint32_t index, uint32_t part, const glm::vec3& offset = glm::vec3(0)) const;
+        glm::vec3 furthest_along(uint32_t index, uint32_t part, const glm::vec3& dir, uint32_t& hint) const;
+        int support_feature(uint32_t index, uint32_t part, const glm::vec3& dir, glm::vec3* out) const;
+        int clip_contacts(const CollisionInfo& ci, const SupportHint& hint, CollisionInfo* out) const;
+
+    public:
+        [[nodiscard]] const Colliders& get_colliders() const { return this->m_colliders; }
+        Colliders& colliders() { return this->m_colliders; }
+        [[nodiscard]] const ColliderMeshes& get_collider_meshes() const { return this->m_meshes; }
+        ColliderMeshes& collider_meshes() { return this->m_meshes; }
+        ColliderMeshId load_collider_mesh(const std::string& filepath);
+
+        ColliderId create_rigidbody(
+            ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+            const glm::vec3& scale = glm::vec3(1.0f), float mass = 1.0f, ShapeType type = ShapeType::Box,
+            uint16_t mask = CollisionMask::Physics
+            );
+        ColliderId create_rigidbody(
+            ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+            float scale = 1.0f, float mass = 1.0f, ShapeType type = ShapeType::Box, uint16_t mask = CollisionMask::Physics
+            );
+        ColliderId create_staticbody(
+            ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+            const glm::vec3& scale = glm::vec3(1.0f), ShapeType type = ShapeType::Custom, uint16_t mask = CollisionMask::Physics
+            );
+        ColliderId create_staticbody(
+            ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+            float scale = 1.0f, ShapeType type = ShapeType::Custom, uint16_t mask = CollisionMask::Physics
+            );
+        ColliderId create_kinematicbody(
+            ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+            const glm::vec3& scale = glm::vec3(1.0f), ShapeType type = ShapeType::Box, uint16_t mask = CollisionMask::Physics
+            );
+        ColliderId create_kinematicbody(
+            ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+            float scale = 1.0f, ShapeType type = ShapeType::Box, uint16_t mask = CollisionMask::Physics
+            );
+        void set_transform(ColliderId collider, const glm::mat4& t);
+        void set_velocity(ColliderId collider, const glm::vec3& linear, const glm::vec3& angular = glm::vec3(0));
+        void destroy_collider(ColliderId collider);
+        [[nodiscard]] uint32_t collider_index(ColliderId collider) const;
+        [[nodiscard]] bool is_valid(ColliderId collider) const;
+        [[nodiscard]] bool is_kinematic(ColliderId collider) const;
+
+        void set_layer_collision(uint16_t layers_a, uint16_t layers_b, bool collide);
+        [[nodiscard]] uint16_t colliding_layers(uint16_t mask) const;
+        [[nodiscard]] bool should_collide(uint16_t mask_a, uint16_t mask_b) const;
+
+        bool cast_ray(const Ray& ray, HitInfo& hit, uint16_t mask = CollisionMask::All) const;
+        bool cast_ray(const glm::vec3& start, const glm::vec3& dir, HitInfo& hit, uint16_t mask = CollisionMask::All) const;
+        void select_triangle(const HitInfo& hit);
+        bool cast_collider(ColliderId collider, const glm::vec3& motion, HitInfo& hit) const;
+
+        void add_center_impulse(ColliderId collider, const glm::vec3& dir);
+        void add_impulse(ColliderId collider, const glm::vec3& loc, const glm::vec3& dir);
+        void wake(ColliderId collider);
+        [[nodiscard]] bool is_awake(ColliderId collider) const;
+        void step(float dt);
+        void advance(uint32_t num_steps);
+        void update_aabbs();
+
+        [[nodiscard]] std::vector<uint8_t> snapshot() const;
+        bool restore(const std::vector<uint8_t>& blob);
+
+        [[nodiscard]] const StepTimings& get_step_timings() const { return this->m_step_timings; }
+        void reset_step_timings() { this->m_step_timings = {}; }
+
+        void sort_and_sweep(std::vector<AABBPair>& aabb_pairs);
+
+        // the narrowphase queries take collider indices, see collider_index. offset_a moves a by that
+        // much in world space, so a shape can be tested somewhere else without touching its transform
+        SupportPoint support(
+            uint32_t a_index, uint32_t b_index, const glm::vec3& dir, SupportHint& hint,
+            const glm::vec3& offset_a = glm::vec3(0)
+            ) const;
+        bool gjk(
+            uint32_t a_index, uint32_t b_index, Simplex& out_simplex, SupportHint& hint, glm::vec3& axis,
+            const glm::vec3& offset_a = glm::vec3(0)
+            ) const;
+        CollisionInfo epa(
+            const Simplex& simplex, uint32_t a_index, uint32_t b_index, SupportHint& hint,
+            const glm::vec3& offset_a = glm::vec3(0)
+            ) const;
+        bool overlap(
+            uint32_t a_index, uint32_t b_index, SupportHint& hint, glm::vec3& axis,
+            const glm::vec3& offset_a = glm::vec3(0)
+            ) const;
+    };
+
+    // the world the free functions work on, debug drawing and the audio rays use it as well
+    World& get_world();
+
     const Colliders& get_colliders();
     Colliders& colliders();
 
     ColliderId create_rigidbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
         const glm::vec3& scale = glm::vec3(1.0f), float mass = 1.0f, ShapeType type = ShapeType::Box,
-        uint16_t mask = 0
+        uint16_t mask = CollisionMask::Physics
         );
     ColliderId create_rigidbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
-        float scale = 1.0f, float mass = 1.0f, ShapeType type = ShapeType::Box, uint16_t mask = 0
+        float scale = 1.0f, float mass = 1.0f, ShapeType type = ShapeType::Box, uint16_t mask = CollisionMask::Physics
         );
     ColliderId create_staticbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
-        const glm::vec3& scale = glm::vec3(1.0f), uint16_t mask = 0
+        const glm::vec3& scale = glm::vec3(1.0f), ShapeType type = ShapeType::Custom, uint16_t mask = CollisionMask::Physics
         );
     ColliderId create_staticbody(
         ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
-        float scale = 1.0f, uint16_t mask = 0
+        float scale = 1.0f, ShapeType type = ShapeType::Custom, uint16_t mask = CollisionMask::Physics
+        );
+    // moved only by the velocity set_velocity gives it, gravity, impulses and contacts leave it alone and
+    // the dynamic bodies in its way are pushed as if it had infinite mass. moving platforms and
+    // character controllers use these
+    ColliderId create_kinematicbody(
+        ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        const glm::vec3& scale = glm::vec3(1.0f), ShapeType type = ShapeType::Box, uint16_t mask = CollisionMask::Physics
         );
+    ColliderId create_kinematicbody(
+        ColliderMeshId cm_id, const glm::vec3& orig, const glm::vec3& translation, const glm::quat& rotation,
+        float scale = 1.0f, ShapeType type = ShapeType::Box, uint16_t mask = CollisionMask::Physics
+        );
+    // teleports the collider, the scale of t has to be the one it was created with. the pose the
+    // integrator moves on from is set as well, so a body carries on from t instead of snapping back
     void set_transform(ColliderId collider, const glm::mat4& t);
+    // replaces the velocity of a dynamic or kinematic body and wakes it. a kinematic body keeps moving
+    // with it until it is set again, it only goes to sleep once it is zero
+    void set_velocity(ColliderId collider, const glm::vec3& linear, const glm::vec3& angular = glm::vec3(0));
+    // removes the collider, the bodies around it are woken so whatever rested on it falls
+    void destroy_collider(ColliderId collider);
+    // slot of the collider in the Colliders arrays, only valid until the next destroy_collider
+    uint32_t collider_index(ColliderId collider);
+    bool is_valid(ColliderId collider);
+    bool is_kinematic(ColliderId collider);
 
     void init_debug();
 
     bool cast_ray(const Ray& ray, HitInfo& hit, uint16_t mask = CollisionMask::All);
     bool cast_ray(const glm::vec3& start, const glm::vec3& dir, HitInfo& hit, uint16_t mask = CollisionMask::All);
+    // marks the hit triangle for debug drawing, cast_ray itself never writes to shared state
+    void select_triangle(const HitInfo& hit);
+    // sweeps the collider along motion from its current pose and finds the first collider in the way that
+    // its layers collide with. hit.t is the distance it can move, hit.pos the contact and hit.norm points
+    // from the hit collider towards the swept one. the broadphase tree and the swept bounds pick the
+    // candidates, gjk only runs on those. nothing is moved for the tests, one that already overlaps
+    // something reports that at t 0
+    bool cast_collider(ColliderId collider, const glm::vec3& motion, HitInfo& hit);
 
     void add_center_impulse(ColliderId collider, const glm::vec3& dir);
     void add_impulse(ColliderId collider, const glm::vec3& loc, const glm::vec3& dir);
+    // wakes the body and every body of its sleeping island, impulses do this implicitly
+    void wake(ColliderId collider);
+    bool is_awake(ColliderId collider);
+    // runs the fixed steps the frame time dt adds up to and updates render_transforms
     void step(float dt);
+    // runs num_steps fixed steps whatever the frame time, render_transforms end up at the last one.
+    // replays and tests drive the simulation with this so that the frame rate can't change the result
+    void advance(uint32_t num_steps);
     void update_aabbs();
 
-    struct AABBPair {
-        ColliderId a, b;
-    };
+    // binary copy of the simulation state: the collider arrays, the handles, the sleeping islands, the
+    // warm start impulses and the layer matrix. meshes are not included, they have to be loaded in the
+    // same order before restoring. the broadphase is rebuilt by restore, so one blob restored twice
+    // simulates the same way both times whatever ran in between
+    std::vector<uint8_t> snapshot();
+    // false if the blob is malformed or refers to meshes that aren't loaded, the state is left as it was
+    bool restore(const std::vector<uint8_t>& blob);
+
+    const StepTimings& get_step_timings();
+    void reset_step_timings();
 
     void sort_and_sweep(std::vector<AABBPair>& aabb_pairs);
 
-    bool gjk(ColliderId a_id, ColliderId b_id, Simplex& out_simplex);
-    CollisionInfo epa(const Simplex& simplex, ColliderId a_id, ColliderId b_id);
-    void collision_solver(const CollisionInfo& collision_info, ColliderId a_id, ColliderId b_id, float dt);
+    // a_index and b_index are collider indices, see collider_index
+    SupportPoint support(uint32_t a_index, uint32_t b_index, const glm::vec3& dir, SupportHint& hint);
+    // axis seeds the search and returns the separating axis, or the search direction if the shapes overlap
+    bool gjk(uint32_t a_index, uint32_t b_index, Simplex& out_simplex, SupportHint& hint, glm::vec3& axis);
+    CollisionInfo epa(const Simplex& simplex, uint32_t a_index, uint32_t b_index, SupportHint& hint);
+    // boolean gjk over every pair of convex parts, hint and axis are only carried over between single part bodies
+    bool overlap(uint32_t a_index, uint32_t b_index, SupportHint& hint, glm::vec3& axis);
 
 } // namespace Physics
@@ -1,10 +1,13 @@
 ﻿#include "config.h"
 #include "physicsmesh.h"
 
+#include <algorithm>
+#include <fstream>
 #include <set>
 
 #include "plane.h"
 #include "ray.h"
+#include "core/debug.h"
 #include "core/idpool.h"
 #include "core/maths.h"
 #include "fx/gltf.h"
@@ -12,10 +15,6 @@
 
 namespace Physics {
 
-    static Util::IdPool<ColliderMeshId> collider_mesh_id_pool;
-    static ColliderMeshes collider_meshes;
-
-
     namespace Internal {
 
         template <typename CompType>
@@ -92,6 +91,109 @@ namespace Physics {
             mesh->depth = aabb->max_bound.z - aabb->min_bound.z;
         }
 
+        constexpr uint32_t hull_cache_magic = 0x4C4C5548; // "HULL"
+        constexpr uint32_t hull_cache_version = 1;
+
+        // hashes the triangles and the settings the hulls were built with, a cache file with another
+        // key is out of date
+        uint64_t HullCacheKey(const ColliderMesh& mesh) {
+            auto key = 0xCBF29CE484222325ull;
+            const auto hash = [&key](const void* data, const std::size_t size) {
+                const auto bytes = static_cast<const uint8_t*>(data);
+                for (std::size_t i = 0; i < size; ++i) {
+                    key = (key ^ bytes[i]) * 0x100000001B3ull;
+                }
+            };
+            for (const auto& p : mesh.primitives) {
+                for (const auto& t : p.triangles) {
+                    hash(&t.v0, sizeof(glm::vec3));
+                    hash(&t.v1, sizeof(glm::vec3));
+                    hash(&t.v2, sizeof(glm::vec3));
+                }
+            }
+            constexpr uint32_t settings[] = {ConvexHull::max_vertices, ConvexDecomposition::max_parts};
+            constexpr auto concavity = ConvexDecomposition::max_concavity;
+            hash(settings, sizeof(settings));
+            hash(&concavity, sizeof(concavity));
+            return key;
+        }
+
+        bool LoadHullCache(const std::string& path, const uint64_t key, ColliderMesh* mesh) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) { return false; }
+
+            const auto read = [&file](void* data, const std::size_t size) {
+                return static_cast<bool>(file.read(static_cast<char*>(data), static_cast<std::streamsize>(size)));
+            };
+            uint32_t magic, version, num_hulls;
+            uint64_t file_key;
+            if (!read(&magic, sizeof(magic)) || !read(&version, sizeof(version)) || !read(&file_key, sizeof(file_key)) ||
+                !read(&num_hulls, sizeof(num_hulls))) {
+                return false;
+            }
+            // the decomposition only writes a cache for meshes that have hulls
+            if (magic != hull_cache_magic || version != hull_cache_version || file_key != key ||
+                num_hulls == 0 || num_hulls > ConvexDecomposition::max_parts) {
+                return false;
+            }
+
+            std::vector<ConvexHull> hulls(num_hulls);
+            for (auto& hull : hulls) {
+                uint32_t num_vertices, num_adjacency;
+                // quickhull starts from a tetrahedron, a hull with fewer vertices didn't come from it
+                if (!read(&num_vertices, sizeof(num_vertices)) || !read(&num_adjacency, sizeof(num_adjacency)) ||
+                    num_vertices < 4 || num_vertices > ConvexHull::max_vertices ||
+                    num_adjacency > num_vertices * num_vertices) {
+                    return false;
+                }
+                hull.vertices.resize(num_vertices);
+                hull.adjacency_offsets.resize(num_vertices + 1);
+                hull.adjacency.resize(num_adjacency);
+                if (!read(hull.vertices.data(), num_vertices * sizeof(glm::vec3)) ||
+                    !read(hull.adjacency_offsets.data(), (num_vertices + 1) * sizeof(uint32_t)) ||
+                    !read(hull.adjacency.data(), num_adjacency * sizeof(uint32_t)) ||
+                    !read(&hull.min_bound, sizeof(glm::vec3)) || !read(&hull.max_bound, sizeof(glm::vec3))) {
+                    return false;
+                }
+                // a truncated or corrupt file must not send the support queries out of bounds
+                if (hull.adjacency_offsets.back() != num_adjacency ||
+                    !std::ranges::is_sorted(hull.adjacency_offsets) ||
+                    std::ranges::any_of(hull.adjacency, [num_vertices](const uint32_t v) { return v >= num_vertices; })) {
+                    return false;
+                }
+            }
+            mesh->hulls = std::move(hulls);
+            return true;
+        }
+
+        void SaveHullCache(const std::string& path, const uint64_t key, const ColliderMesh& mesh) {
+            // flat meshes have no hulls and are cheap to decompose again
+            if (mesh.hulls.empty()) { return; }
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            const auto write = [&file](const void* data, const std::size_t size) {
+                file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            };
+            const auto num_hulls = static_cast<uint32_t>(mesh.hulls.size());
+            write(&hull_cache_magic, sizeof(hull_cache_magic));
+            write(&hull_cache_version, sizeof(hull_cache_version));
+            write(&key, sizeof(key));
+            write(&num_hulls, sizeof(num_hulls));
+            for (const auto& hull : mesh.hulls) {
+                const auto num_vertices = static_cast<uint32_t>(hull.vertices.size());
+                const auto num_adjacency = static_cast<uint32_t>(hull.adjacency.size());
+                write(&num_vertices, sizeof(num_vertices));
+                write(&num_adjacency, sizeof(num_adjacency));
+                write(hull.vertices.data(), num_vertices * sizeof(glm::vec3));
+                write(hull.adjacency_offsets.data(), (num_vertices + 1) * sizeof(uint32_t));
+                write(hull.adjacency.data(), num_adjacency * sizeof(uint32_t));
+                write(&hull.min_bound, sizeof(glm::vec3));
+                write(&hull.max_bound, sizeof(glm::vec3));
+            }
+            // the hulls are rebuilt on the next load if the cache can't be written, read only assets are fine
+            if (!file) { n_warning("could not write collider hull cache %s\n", path.c_str()); }
+        }
+
     }
 
 
@@ -122,6 +224,11 @@ namespace Physics {
     }
 
     bool ColliderMesh::intersect(const Ray& r, HitInfo& hit) const {
+        if (this->layout == Layout::BVH4) {
+            return this->bvh.intersect(*this, r, hit);
+        }
+
+        auto found = false;
         for (std::size_t i = 0; i < this->primitives.size(); ++i) {
             const auto& p = this->primitives[i];
             for (std::size_t j = 0; j < p.triangles.size(); ++j) {
@@ -132,37 +239,35 @@ namespace Physics {
                         hit = temp_hit;
                         hit.prim_n = i;
                         hit.tri_n = j;
+                        found = true;
                     }
                 }
             }
         }
 
-        return hit.hit();
-    }
-
-    glm::vec3 ColliderMesh::furthest_along(const glm::mat4& t, const glm::vec3& dir) const {
-        glm::vec3 best_point{};
-        float best_dist{-max_f};
-        for (const auto& v : this->vertices) {
-            const auto point = glm::vec3(t * glm::vec4(v, 1.0f));
-            const auto dist = glm::dot(point, dir);
-            if (dist > best_dist) {
-                best_point = point;
-                best_dist = dist;
-            }
-        }
-        return best_point;
+        return found;
     }
 
     std::size_t ColliderMesh::num_of_vertices() const {
         return this->vertices.size();
     }
 
+    std::size_t ColliderMesh::num_of_triangles() const {
+        std::size_t count{0};
+        for (const auto& p : this->primitives) { count += p.triangles.size(); }
+        return count;
+    }
+
     void AABB::grow(const glm::vec3& p) {
         this->min_bound = glm::min(this->min_bound, p);
         this->max_bound = glm::max(this->max_bound, p);
     }
 
+    void AABB::grow(const AABB& other) {
+        this->min_bound = glm::min(this->min_bound, other.min_bound);
+        this->max_bound = glm::max(this->max_bound, other.max_bound);
+    }
+
     void AABB::grow_rot(const glm::mat4& t) {
         const auto xa = t[0] * this->min_bound.x;
         const auto xb = t[0] * this->max_bound.x;
@@ -197,22 +302,38 @@ namespace Physics {
          (this->min_bound.z <= other.max_bound.z && this->max_bound.z >= other.min_bound.z);
     }
 
+    bool AABB::contains(const AABB& other) const {
+        return glm::all(glm::lessThanEqual(this->min_bound, other.min_bound)) &&
+            glm::all(glm::greaterThanEqual(this->max_bound, other.max_bound));
+    }
+
+    float AABB::area() const {
+        const auto d = this->max_bound - this->min_bound;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    AABB combine(const AABB& a, const AABB& b) {
+        AABB ret{a};
+        ret.grow(b);
+        return ret;
+    }
+
     AABB rotate_aabb_affine(const AABB& orig, const glm::mat4& t) {
         AABB ret{orig};
         ret.grow_rot(t);
         return ret;
     }
 
-    ColliderMeshId load_collider_mesh(const std::string& filepath) {
+    ColliderMeshId ColliderMeshes::load(const std::string& filepath) {
         ColliderMeshId mesh_id;
         AABB* aabb;
         ColliderMesh* mesh;
-        if (collider_mesh_id_pool.Allocate(mesh_id)) {
-            collider_meshes.simple.emplace_back();
-            collider_meshes.complex.emplace_back();
+        if (this->id_pool.Allocate(mesh_id)) {
+            this->simple.emplace_back();
+            this->complex.emplace_back();
         }
-        aabb = &collider_meshes.simple[mesh_id.index];
-        mesh = &collider_meshes.complex[mesh_id.index];
+        aabb = &this->simple[mesh_id.index];
+        mesh = &this->complex[mesh_id.index];
 
         fx::gltf::Document doc;
         try {
@@ -224,7 +345,7 @@ namespace Physics {
 #if _DEBUG
             assert(false);
 #endif
-            collider_mesh_id_pool.Deallocate(mesh_id);
+            this->id_pool.Deallocate(mesh_id);
             return {};
         }
 
@@ -266,9 +387,19 @@ namespace Physics {
 
         mesh->center /= static_cast<float>(mesh->num_of_vertices());
 
+        const auto cache_path = filepath + ".hulls";
+        const auto key = Internal::HullCacheKey(*mesh);
+        if (!Internal::LoadHullCache(cache_path, key, mesh)) {
+            ConvexDecomposition::build(*mesh, mesh->hulls);
+            Internal::SaveHullCache(cache_path, key, *mesh);
+        }
+
+        if (mesh->num_of_triangles() >= ColliderMesh::bvh_min_triangles) {
+            mesh->bvh.build(*mesh);
+            mesh->layout = ColliderMesh::Layout::BVH4;
+        }
+
         return mesh_id;
     }
 
-    ColliderMeshes& get_collider_meshes() { return collider_meshes; }
-
 } // namespace Physics
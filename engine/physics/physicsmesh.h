@@ -1,6 +1,9 @@
 ﻿#pragma once
+#include "bvh.h"
+#include "convexhull.h"
 #include "physicsresource.h"
 #include "vec3.hpp"
+#include "core/idpool.h"
 
 
 namespace Physics {
@@ -30,6 +33,14 @@ namespace Physics {
             std::vector<Triangle> triangles;
         };
 
+        enum class Layout : uint8_t {
+            Triangles = 0,
+            BVH4,
+        };
+
+        // meshes below this triangle count are cheaper to test brute force
+        static constexpr auto bvh_min_triangles = 16;
+
         glm::vec3 center = glm::vec3(0);
         float radius = 0.0f;
         float width = 0.0f;
@@ -37,11 +48,17 @@ namespace Physics {
         float depth = 0.0f;
         std::vector<glm::vec3> vertices;
         std::vector<Primitive> primitives;
+        Layout layout = Layout::Triangles;
+        BVH4 bvh;
+
+        // the triangles are only used for ray casts, collisions go against the convex parts of the mesh
+        std::vector<ConvexHull> hulls;
 
+        [[nodiscard]] std::size_t num_of_triangles() const;
         [[nodiscard]] std::size_t num_of_vertices() const;
 
+        // hit.t bounds the search, true only if a triangle closer than that was found and written to hit
         bool intersect(const Ray& r, HitInfo& hit) const;
-        [[nodiscard]] glm::vec3 furthest_along(const glm::mat4& t, const glm::vec3& dir) const;
     };
 
     struct AABB {
@@ -55,21 +72,32 @@ namespace Physics {
         explicit AABB() : min_bound(max_f), max_bound(-max_f) {}
 
         void grow(const glm::vec3& p);
+        void grow(const AABB& other);
         void grow_rot(const glm::mat4& t);
 
         bool intersect(const Ray& r, HitInfo& hit) const;
         bool intersect(const AABB& other) const;
+        [[nodiscard]] bool contains(const AABB& other) const;
+        [[nodiscard]] float area() const;
     };
 
+    AABB combine(const AABB& a, const AABB& b);
+
     AABB rotate_aabb_affine(const AABB& orig, const glm::mat4& t);
 
+    // the meshes of one world, indexed by ColliderMeshId
     struct ColliderMeshes {
         std::vector<AABB> simple;
         std::vector<ColliderMesh> complex;
+        Util::IdPool<ColliderMeshId> id_pool;
+
+        // the convex parts are read from a cache file next to the mesh, or decomposed and written there
+        // if it is missing or was made from different triangles or settings
+        ColliderMeshId load(const std::string& filepath);
     };
 
+    // the meshes of the world returned by get_world()
     ColliderMeshes& get_collider_meshes();
-
     ColliderMeshId load_collider_mesh(const std::string& filepath);
 
 } // namespace Physics
\ No newline at end of file
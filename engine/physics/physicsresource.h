@@ -79,11 +79,21 @@ namespace Physics {
         glm::vec3 normal{0};
         float penetration_depth{0.0f};
         bool has_collision{false};
-        ColliderId a_id, b_id;
+        // collider indices of the two bodies, not handles
+        uint32_t a_index{0}, b_index{0};
     };
 
     struct SupportPoint {
         glm::vec3 point, a, b;
     };
 
+    // support vertex hints for both bodies of a pair, carried from one support query to the next,
+    // and the convex part of each body the queries go to
+    struct SupportHint {
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t part_a = 0;
+        uint32_t part_b = 0;
+    };
+
 } // namespace Physics
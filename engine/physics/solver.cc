@@ -0,0 +1,237 @@
+﻿#include "config.h"
+#include "solver.h"
+
+#include "core/maths.h"
+#include "physics/paircache.h"
+#include "physics/phy.h"
+
+
+namespace Physics {
+
+    namespace Internal {
+
+        // fixed basis around the normal, the tangents have to stay put between steps for the
+        // cached friction impulses to still point the right way
+        void tangent_basis(const glm::vec3& n, glm::vec3& t1, glm::vec3& t2) {
+            if (glm::abs(n.x) >= 0.57735f) {
+                t1 = glm::normalize(glm::vec3(n.y, -n.x, 0.0f));
+            }
+            else {
+                t1 = glm::normalize(glm::vec3(0.0f, n.z, -n.y));
+            }
+            t2 = glm::cross(n, t1);
+        }
+
+        float effective_mass(
+            const glm::vec3& dir, const glm::vec3& r_a, const glm::vec3& r_b,
+            const float inv_mass_a, const float inv_mass_b, const glm::mat3& inv_inertia_a, const glm::mat3& inv_inertia_b
+            ) {
+            const auto a_rn = glm::cross(r_a, dir);
+            const auto b_rn = glm::cross(r_b, dir);
+            const auto k = inv_mass_a + inv_mass_b + glm::dot(a_rn, inv_inertia_a * a_rn) + glm::dot(b_rn, inv_inertia_b * b_rn);
+            return k > 0.0f ? 1.0f / k : 0.0f;
+        }
+
+    }
+
+    void ContactConstraints::clear() {
+        this->body_a.clear();
+        this->body_b.clear();
+        this->r_a.clear();
+        this->r_b.clear();
+        this->normal.clear();
+        this->tangent_1.clear();
+        this->tangent_2.clear();
+        this->normal_mass.clear();
+        this->tangent_mass_1.clear();
+        this->tangent_mass_2.clear();
+        this->bias.clear();
+        this->position_bias.clear();
+        this->position_impulse.clear();
+        this->normal_impulse.clear();
+        this->tangent_impulse_1.clear();
+        this->tangent_impulse_2.clear();
+        this->cache.clear();
+    }
+
+    void ContactConstraints::push_back(const uint32_t a, const uint32_t b, ContactPoint* point) {
+        this->body_a.push_back(a);
+        this->body_b.push_back(b);
+        this->r_a.emplace_back(0.0f);
+        this->r_b.emplace_back(0.0f);
+        this->normal.emplace_back(0.0f);
+        this->tangent_1.emplace_back(0.0f);
+        this->tangent_2.emplace_back(0.0f);
+        this->normal_mass.push_back(0.0f);
+        this->tangent_mass_1.push_back(0.0f);
+        this->tangent_mass_2.push_back(0.0f);
+        this->bias.push_back(0.0f);
+        this->position_bias.push_back(0.0f);
+        this->position_impulse.push_back(0.0f);
+        this->normal_impulse.push_back(point->normal_impulse);
+        this->tangent_impulse_1.push_back(point->tangent_impulse[0]);
+        this->tangent_impulse_2.push_back(point->tangent_impulse[1]);
+        this->cache.push_back(point);
+    }
+
+    void ContactSolver::add_body(const uint32_t index, const Colliders& colliders) {
+        if (this->m_used[index]) { return; }
+        this->m_used[index] = 1;
+        this->m_bodies.push_back(index);
+        this->m_position_vel[index] = glm::vec3(0);
+        this->m_position_angular_vel[index] = glm::vec3(0);
+
+        if (colliders.is_static[index]) {
+            this->m_vel[index] = glm::vec3(0);
+            this->m_angular_vel[index] = glm::vec3(0);
+            this->m_inv_mass[index] = 0.0f;
+            this->m_inv_inertia[index] = glm::mat3(0);
+            return;
+        }
+        const auto& state = colliders.states[index];
+        const auto rotm = glm::mat3_cast(colliders.dynamics.rot[index]);
+        this->m_vel[index] = colliders.dynamics.vel[index];
+        this->m_angular_vel[index] = colliders.dynamics.angular_vel[index];
+        this->m_inv_mass[index] = state.inv_mass;
+        this->m_inv_inertia[index] = rotm * state.inv_inertia_shape * glm::transpose(rotm);
+    }
+
+    void ContactSolver::apply(const std::size_t k, const glm::vec3& impulse) {
+        const auto& c = this->m_constraints;
+        const auto a = c.body_a[k];
+        const auto b = c.body_b[k];
+        this->m_vel[a] += impulse * this->m_inv_mass[a];
+        this->m_angular_vel[a] += this->m_inv_inertia[a] * glm::cross(c.r_a[k], impulse);
+        this->m_vel[b] -= impulse * this->m_inv_mass[b];
+        this->m_angular_vel[b] -= this->m_inv_inertia[b] * glm::cross(c.r_b[k], impulse);
+    }
+
+    void ContactSolver::apply_position(const std::size_t k, const glm::vec3& impulse) {
+        const auto& c = this->m_constraints;
+        const auto a = c.body_a[k];
+        const auto b = c.body_b[k];
+        this->m_position_vel[a] += impulse * this->m_inv_mass[a];
+        this->m_position_angular_vel[a] += this->m_inv_inertia[a] * glm::cross(c.r_a[k], impulse);
+        this->m_position_vel[b] -= impulse * this->m_inv_mass[b];
+        this->m_position_angular_vel[b] -= this->m_inv_inertia[b] * glm::cross(c.r_b[k], impulse);
+    }
+
+    void ContactSolver::prepare(
+        const std::vector<CollisionInfo>& contacts, const std::vector<ContactPoint*>& points,
+        const Colliders& colliders, const float dt
+        ) {
+        assert(contacts.size() == points.size());
+        auto& c = this->m_constraints;
+        c.clear();
+        for (const auto i : this->m_bodies) {
+            this->m_used[i] = 0;
+        }
+        this->m_bodies.clear();
+        this->m_dt = dt;
+
+        const auto num_bodies = colliders.states.size();
+        this->m_vel.resize(num_bodies);
+        this->m_angular_vel.resize(num_bodies);
+        this->m_position_vel.resize(num_bodies);
+        this->m_position_angular_vel.resize(num_bodies);
+        this->m_inv_mass.resize(num_bodies);
+        this->m_inv_inertia.resize(num_bodies);
+        this->m_used.resize(num_bodies, 0);
+
+        for (std::size_t k = 0; k < contacts.size(); ++k) {
+            const auto& ci = contacts[k];
+            const auto a = ci.a_index;
+            const auto b = ci.b_index;
+            this->add_body(a, colliders);
+            this->add_body(b, colliders);
+            c.push_back(a, b, points[k]);
+
+            const auto n = ci.normal;
+            c.normal[k] = n;
+            Internal::tangent_basis(n, c.tangent_1[k], c.tangent_2[k]);
+            c.r_a[k] = ci.contact_point - glm::vec3(colliders.transforms[a] * glm::vec4(colliders.states[a].orig, 1.0f));
+            c.r_b[k] = ci.contact_point - glm::vec3(colliders.transforms[b] * glm::vec4(colliders.states[b].orig, 1.0f));
+
+            const auto inv_mass_a = this->m_inv_mass[a];
+            const auto inv_mass_b = this->m_inv_mass[b];
+            const auto& inv_inertia_a = this->m_inv_inertia[a];
+            const auto& inv_inertia_b = this->m_inv_inertia[b];
+            c.normal_mass[k] = Internal::effective_mass(n, c.r_a[k], c.r_b[k], inv_mass_a, inv_mass_b, inv_inertia_a, inv_inertia_b);
+            c.tangent_mass_1[k] = Internal::effective_mass(c.tangent_1[k], c.r_a[k], c.r_b[k], inv_mass_a, inv_mass_b, inv_inertia_a, inv_inertia_b);
+            c.tangent_mass_2[k] = Internal::effective_mass(c.tangent_2[k], c.r_a[k], c.r_b[k], inv_mass_a, inv_mass_b, inv_inertia_a, inv_inertia_b);
+
+            const auto rel_vel =
+                this->m_vel[a] + glm::cross(this->m_angular_vel[a], c.r_a[k]) -
+                this->m_vel[b] - glm::cross(this->m_angular_vel[b], c.r_b[k]);
+            const auto vn = glm::dot(rel_vel, n);
+
+            // points of the manifold that are still apart may close the gap within this step
+            auto bias = Math::min(0.0f, ci.penetration_depth / dt);
+            if (vn < -restitution_threshold) {
+                bias = Math::max(bias, -restitution * vn);
+            }
+            c.bias[k] = bias;
+            c.position_bias[k] = baumgarte / dt * Math::max(0.0f, ci.penetration_depth - slop);
+        }
+    }
+
+    void ContactSolver::warm_start() {
+        const auto& c = this->m_constraints;
+        for (std::size_t k = 0; k < c.size(); ++k) {
+            this->apply(k, c.normal_impulse[k] * c.normal[k] + c.tangent_impulse_1[k] * c.tangent_1[k] + c.tangent_impulse_2[k] * c.tangent_2[k]);
+        }
+    }
+
+    void ContactSolver::solve() {
+        auto& c = this->m_constraints;
+        for (std::size_t k = 0; k < c.size(); ++k) {
+            const auto a = c.body_a[k];
+            const auto b = c.body_b[k];
+
+            // friction first, its limit comes from the normal impulse of the previous iteration
+            const auto max_friction = friction * c.normal_impulse[k];
+            auto rel_vel =
+                this->m_vel[a] + glm::cross(this->m_angular_vel[a], c.r_a[k]) -
+                this->m_vel[b] - glm::cross(this->m_angular_vel[b], c.r_b[k]);
+
+            const auto old_t1 = c.tangent_impulse_1[k];
+            c.tangent_impulse_1[k] = glm::clamp(old_t1 - glm::dot(rel_vel, c.tangent_1[k]) * c.tangent_mass_1[k], -max_friction, max_friction);
+            const auto old_t2 = c.tangent_impulse_2[k];
+            c.tangent_impulse_2[k] = glm::clamp(old_t2 - glm::dot(rel_vel, c.tangent_2[k]) * c.tangent_mass_2[k], -max_friction, max_friction);
+            this->apply(k, (c.tangent_impulse_1[k] - old_t1) * c.tangent_1[k] + (c.tangent_impulse_2[k] - old_t2) * c.tangent_2[k]);
+
+            rel_vel =
+                this->m_vel[a] + glm::cross(this->m_angular_vel[a], c.r_a[k]) -
+                this->m_vel[b] - glm::cross(this->m_angular_vel[b], c.r_b[k]);
+            const auto old_n = c.normal_impulse[k];
+            c.normal_impulse[k] = Math::max(0.0f, old_n + (c.bias[k] - glm::dot(rel_vel, c.normal[k])) * c.normal_mass[k]);
+            this->apply(k, (c.normal_impulse[k] - old_n) * c.normal[k]);
+
+            if (c.position_bias[k] == 0.0f && c.position_impulse[k] == 0.0f) { continue; }
+            const auto position_vel =
+                this->m_position_vel[a] + glm::cross(this->m_position_angular_vel[a], c.r_a[k]) -
+                this->m_position_vel[b] - glm::cross(this->m_position_angular_vel[b], c.r_b[k]);
+            const auto old_p = c.position_impulse[k];
+            c.position_impulse[k] = Math::max(0.0f, old_p + (c.position_bias[k] - glm::dot(position_vel, c.normal[k])) * c.normal_mass[k]);
+            this->apply_position(k, (c.position_impulse[k] - old_p) * c.normal[k]);
+        }
+    }
+
+    void ContactSolver::finish(Colliders& colliders) {
+        const auto& c = this->m_constraints;
+        for (std::size_t k = 0; k < c.size(); ++k) {
+            c.cache[k]->normal_impulse = c.normal_impulse[k];
+            c.cache[k]->tangent_impulse[0] = c.tangent_impulse_1[k];
+            c.cache[k]->tangent_impulse[1] = c.tangent_impulse_2[k];
+        }
+        for (const auto i : this->m_bodies) {
+            if (this->m_inv_mass[i] == 0.0f) { continue; }
+            auto& dyn = colliders.dynamics;
+            dyn.vel[i] = this->m_vel[i];
+            dyn.angular_vel[i] = this->m_angular_vel[i];
+            dyn.pos[i] += this->m_position_vel[i] * this->m_dt;
+            dyn.rot[i] = glm::normalize(dyn.rot[i] + 0.5f * glm::quat(0.0f, this->m_position_angular_vel[i]) * dyn.rot[i] * this->m_dt);
+        }
+    }
+
+} // namespace Physics
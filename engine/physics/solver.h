@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <vector>
+
+#include "physicsresource.h"
+
+
+namespace Physics {
+
+    struct Colliders;
+    struct ContactPoint;
+
+    // packed contact constraints, one entry per manifold point, stored as separate arrays so the
+    // solver iterations only touch the fields they read
+    struct ContactConstraints {
+        std::vector<uint32_t> body_a;
+        std::vector<uint32_t> body_b;
+        std::vector<glm::vec3> r_a;
+        std::vector<glm::vec3> r_b;
+        std::vector<glm::vec3> normal;
+        std::vector<glm::vec3> tangent_1;
+        std::vector<glm::vec3> tangent_2;
+        std::vector<float> normal_mass;
+        std::vector<float> tangent_mass_1;
+        std::vector<float> tangent_mass_2;
+        // target separating velocity from restitution, negative for points that are still apart
+        std::vector<float> bias;
+        // separating velocity that pushes the bodies out of each other, solved apart from the real
+        // velocities so the correction doesn't turn into kinetic energy
+        std::vector<float> position_bias;
+        std::vector<float> position_impulse;
+        std::vector<float> normal_impulse;
+        std::vector<float> tangent_impulse_1;
+        std::vector<float> tangent_impulse_2;
+        // manifold point the accumulated impulses are written back to for the next warm start
+        std::vector<ContactPoint*> cache;
+
+        void clear();
+        void push_back(uint32_t a, uint32_t b, ContactPoint* point);
+
+        [[nodiscard]] std::size_t size() const { return this->body_a.size(); }
+    };
+
+    // sequential impulse solver, gauss-seidel over the contact constraints with the accumulated
+    // impulse of every constraint clamped instead of the per iteration delta
+    struct ContactSolver {
+        static constexpr auto restitution = 0.6f;
+        // closing speeds below this don't bounce, resting contacts would jitter otherwise
+        static constexpr auto restitution_threshold = 1.0f;
+        static constexpr auto friction = 0.5f;
+        static constexpr auto baumgarte = 0.2f;
+        static constexpr auto slop = 0.005f;
+
+    private:
+        ContactConstraints m_constraints;
+        // solver copies of the body velocities, indexed by collider index
+        std::vector<glm::vec3> m_vel;
+        std::vector<glm::vec3> m_angular_vel;
+        // velocities that only move the bodies out of penetration this step and are dropped afterwards
+        std::vector<glm::vec3> m_position_vel;
+        std::vector<glm::vec3> m_position_angular_vel;
+        std::vector<glm::mat3> m_inv_inertia;
+        std::vector<float> m_inv_mass;
+        std::vector<uint8_t> m_used;
+        std::vector<uint32_t> m_bodies;
+        float m_dt = 0.0f;
+
+        void add_body(uint32_t index, const Colliders& colliders);
+        void apply(std::size_t k, const glm::vec3& impulse);
+        void apply_position(std::size_t k, const glm::vec3& impulse);
+
+    public:
+        // builds the constraints for the contacts and their manifold points, both lists line up
+        void prepare(
+            const std::vector<CollisionInfo>& contacts, const std::vector<ContactPoint*>& points,
+            const Colliders& colliders, float dt
+            );
+        // applies the impulses of the last step so the iterations start close to the solution
+        void warm_start();
+        void solve();
+        // stores the accumulated impulses in the manifolds and the velocities in the bodies, the
+        // penetration recovery is applied to the positions right away
+        void finish(Colliders& colliders);
+    };
+
+} // namespace Physics
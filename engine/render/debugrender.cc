@@ -248,9 +248,11 @@ namespace Debug {
     void DrawCMesh(const Physics::ColliderId cm_id) {
         const auto& colliders = Physics::get_colliders();
         const auto& cms = Physics::get_collider_meshes();
-        const auto& mesh = cms.complex[colliders.meshes[cm_id.index].index];
-        const auto& t = colliders.transforms[cm_id.index];
-        const auto& s = colliders.states[cm_id.index];
+        const auto index = Physics::collider_index(cm_id);
+        const auto& mesh = cms.complex[colliders.meshes[index].index];
+        const auto& t = colliders.render_transforms[index];
+        const auto& pos = colliders.dynamics.pos[index];
+        const auto& angular_vel = colliders.dynamics.angular_vel[index];
         for (const auto& p : mesh.primitives) {
             for (const auto& tri : p.triangles) {
                 Debug::DrawTriangle(
@@ -258,13 +260,13 @@ namespace Debug {
                     t * glm::scale(glm::vec3(1.0f + 0.01f)),
                     glm::vec4(1,1,0,1),
                     1.0f,
-                    (cm_id.index == Core::CVarReadInt(r_draw_cm_id) && tri.selected) ? Normal : WireFrame
+                    (index == Core::CVarReadInt(r_draw_cm_id) && tri.selected) ? Normal : WireFrame
                 );
             }
         }
         Debug::DrawLine(
-            s.dyn.pos - glm::vec3(s.dyn.angular_vel.x, s.dyn.angular_vel.y, s.dyn.angular_vel.z),
-            s.dyn.pos + glm::vec3(s.dyn.angular_vel.x, s.dyn.angular_vel.y, s.dyn.angular_vel.z),
+            pos - angular_vel,
+            pos + angular_vel,
             2.0f,
             glm::vec4(0.5,0,1,1)
         );
@@ -272,8 +274,8 @@ namespace Debug {
 
     void DrawCMeshes() {
         const auto& colliders = Physics::get_colliders();
-        for (std::size_t cm_id = 0; cm_id < colliders.meshes.size(); ++cm_id) {
-            DrawCMesh(Physics::ColliderId(cm_id));
+        for (const auto cm_id : colliders.ids) {
+            DrawCMesh(cm_id);
         }
     }
 
@@ -282,7 +284,7 @@ namespace Debug {
         const auto& colliders = Physics::get_colliders();
         if (const auto cm_id = Core::CVarReadInt(r_draw_cm_id);
             cm_id >= 0 && cm_id < colliders.meshes.size()) {
-            DrawCMesh(Physics::ColliderId(cm_id));
+            DrawCMesh(colliders.ids[cm_id]);
         }
 #endif
     }
@@ -0,0 +1,166 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Headless check that the ray queries don't allocate once they are warmed up.
+// Global operator new is replaced with a counting one, a physics ray wave and an
+// audio trace are run until their buffers have grown, and the next run of each
+// has to get by without a single allocation. Exits with 1 if one allocates.
+//
+// usage: alloc-test [--colliders n] [--rays n]
+//
+// (C) 2026 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio/audio_manager.h"
+#include "core/jobsystem.h"
+#include "core/maths.h"
+#include "core/random.h"
+#include "physics/phy.h"
+#include "physics/physicsmesh.h"
+#include "physics/ray.h"
+
+
+namespace AllocTest {
+
+    // every thread allocates through here, the workers of the job pool included
+    std::atomic<std::size_t> num_allocations{0};
+
+}
+
+void* operator new(const std::size_t size) {
+    AllocTest::num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size > 0 ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+
+namespace AllocTest {
+
+    struct Options {
+        int colliders = 512;
+        std::size_t rays = 4096;
+    };
+
+    Options parse_options(const int argc, const char** argv) {
+        Options opt;
+        for (auto i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--colliders") == 0 && i + 1 < argc) { opt.colliders = atoi(argv[++i]); }
+            else if (std::strcmp(argv[i], "--rays") == 0 && i + 1 < argc) { opt.rays = strtoul(argv[++i], nullptr, 10); }
+        }
+        return opt;
+    }
+
+    struct Wave {
+        std::vector<Physics::Ray> rays;
+        std::atomic<std::size_t> hits{0};
+    };
+
+    // the lambda only captures the wave so that handing it to the pool doesn't allocate either
+    void run_wave(Wave& wave) {
+        Core::JobSystem::Get().ParallelFor(wave.rays.size(), 64, [&wave](const std::size_t begin, const std::size_t end) {
+            std::size_t range_hits = 0;
+            for (auto i = begin; i < end; ++i) {
+                if (Physics::HitInfo hit;
+                    Physics::cast_ray(wave.rays[i], hit, Physics::CollisionMask::Audio)) {
+                    ++range_hits;
+                }
+            }
+            wave.hits.fetch_add(range_hits, std::memory_order_relaxed);
+        });
+    }
+
+    // runs one cast on every thread of the pool at the same time, the jobs wait for each other so no
+    // thread can take two of them. thread local query storage is sized on the first call of a thread
+    void warm_up_threads(const Physics::Ray& ray) {
+        auto& pool = Core::JobSystem::Get();
+        const auto num_threads = static_cast<int>(pool.NumWorkers()) + 1;
+        std::atomic<int> arrived{0};
+        Core::JobCounter counter;
+        for (auto t = 0; t < num_threads; ++t) {
+            pool.Run([&arrived, &ray, num_threads]() {
+                arrived.fetch_add(1, std::memory_order_acq_rel);
+                while (arrived.load(std::memory_order_acquire) < num_threads) { std::this_thread::yield(); }
+                Physics::HitInfo hit;
+                Physics::cast_ray(ray, hit, Physics::CollisionMask::Audio);
+            }, &counter);
+        }
+        pool.Wait(&counter);
+    }
+
+    bool check(const char* name, const std::size_t before) {
+        const auto allocations = num_allocations.load() - before;
+        printf("%s: %zu allocations\n", name, allocations);
+        return allocations == 0;
+    }
+
+} // namespace AllocTest
+
+int main(int argc, const char** argv) {
+    const auto opt = AllocTest::parse_options(argc, argv);
+    Core::RandomSeed(1);
+
+    const std::string paths[] = {
+        fs::create_path_from_rel_s("assets/system/cube.glb"),
+        fs::create_path_from_rel_s("assets/system/icosphere.glb"),
+        fs::create_path_from_rel_s("assets/space/Asteroid_1_physics.glb"),
+    };
+    std::vector<Physics::ColliderMeshId> meshes;
+    for (const auto& path : paths) {
+        if (!std::filesystem::exists(path)) {
+            fprintf(stderr, "missing mesh %s\n", path.c_str());
+            return 1;
+        }
+        meshes.push_back(Physics::load_collider_mesh(path));
+    }
+
+    constexpr auto extent = 40.0f;
+    for (auto i = 0; i < opt.colliders; ++i) {
+        const auto mesh = meshes[i % meshes.size()];
+        const auto pos = extent * glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP());
+        const auto rot = glm::angleAxis(Core::RandomFloat() * 2.0f * Math::pi_f, Core::RandomPointOnUnitSphere());
+        Physics::create_staticbody(
+            mesh, Physics::get_collider_meshes().complex[mesh.index].center, pos, rot, 1.0f, Physics::ShapeType::Custom,
+            Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
+            );
+    }
+
+    // closest hits and line of sight segments, the way the audio tracer uses them
+    AllocTest::Wave wave;
+    wave.rays.reserve(opt.rays);
+    for (std::size_t i = 0; i < opt.rays; ++i) {
+        const auto from = extent * glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP());
+        const auto to = extent * glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP());
+        wave.rays.emplace_back(from, to - from, i % 2 == 0);
+    }
+
+    AllocTest::warm_up_threads(wave.rays.front());
+    AllocTest::run_wave(wave);
+    auto ok = true;
+    auto before = AllocTest::num_allocations.load();
+    AllocTest::run_wave(wave);
+    ok &= AllocTest::check("cast_ray wave", before);
+
+    // the manager loads its sound and sizes its ray batches when it is created
+    auto& audio = Audio::AudioManager::get();
+    audio.update_listener_pos_and_at(glm::vec3(0, 0, 0), glm::quat());
+    audio.update_emitter_position(glm::vec3(5, 0, 0));
+    audio.trace();
+    audio.trace();
+    before = AllocTest::num_allocations.load();
+    audio.trace();
+    ok &= AllocTest::check("audio trace", before);
+
+    return ok ? 0 : 1;
+}
@@ -111,6 +111,7 @@ namespace Game {
                 translation,
                 glm::quat(),
                 glm::vec3(100.0f, 1.0f, 100.0f),
+                Physics::ShapeType::Box,
                 Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
                 );
             cubes.emplace_back(cube);
@@ -125,6 +126,7 @@ namespace Game {
                 translation,
                 glm::quat(),
                 glm::vec3(7.5f, 2.0f, 0.1f),
+                Physics::ShapeType::Box,
                 Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
                 );
             cubes.emplace_back(cube);
@@ -139,6 +141,7 @@ namespace Game {
                 translation,
                 glm::quat(),
                 glm::vec3(0.1f, 2.0f, 7.5f),
+                Physics::ShapeType::Box,
                 Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
                 );
             cubes.emplace_back(cube);
@@ -153,6 +156,7 @@ namespace Game {
                 translation,
                 glm::quat(),
                 glm::vec3(0.1f, 2.0f, 7.5f),
+                Physics::ShapeType::Box,
                 Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
                 );
             cubes.emplace_back(cube);
@@ -168,6 +172,7 @@ namespace Game {
                 translation,
                 glm::quat(),
                 glm::vec3(0.5f),
+                Physics::ShapeType::Box,
                 Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
                 );
             cubes.emplace_back(cube);
@@ -184,6 +189,7 @@ namespace Game {
                 translation,
                 glm::quat(),
                 glm::vec3(0.5f),
+                Physics::ShapeType::Box,
                 Physics::CollisionMask::Physics | Physics::CollisionMask::AudioSource
                 );
             sound_cube = std::get<1>(cube);
@@ -226,7 +232,7 @@ namespace Game {
         }
 
         Audio::AudioManager::get().set_emitter_collider(sound_cube);
-        Audio::AudioManager::get().update_emitter_position(Physics::get_colliders().states[sound_cube.index].dyn.pos);
+        Audio::AudioManager::get().update_emitter_position(Physics::get_colliders().dynamics.pos[Physics::collider_index(sound_cube)]);
 
         Physics::Ray r(glm::vec3(0, 0, 0), glm::vec3(0, 0, 0));
         Physics::HitInfo hit;
@@ -251,9 +257,10 @@ namespace Game {
                 const auto aabb_id = Core::CVarGet("r_draw_aabb_id");
                 const auto cm_id = Core::CVarGet("r_draw_cm_id");
                 if (Physics::cast_ray(r, hit)) {
+                    Physics::select_triangle(hit);
                     Core::CVarWriteInt(aabb, 1);
-                    Core::CVarWriteInt(aabb_id, hit.collider.index);
-                    Core::CVarWriteInt(cm_id, hit.collider.index);
+                    Core::CVarWriteInt(aabb_id, Physics::collider_index(hit.collider));
+                    Core::CVarWriteInt(cm_id, Physics::collider_index(hit.collider));
                     Physics::add_impulse(hit.collider, hit.pos, 1.0f * r.dir);
                 }
                 else {
@@ -280,7 +287,7 @@ namespace Game {
 
             // Store all drawcalls in the render device
             for (auto& [model, collider]: cubes) {
-                RenderDevice::Draw(model, Physics::get_colliders().transforms[collider.index]);
+                RenderDevice::Draw(model, Physics::get_colliders().render_transforms[Physics::collider_index(collider)]);
             }
 
             Debug::DrawGrid();
@@ -356,7 +363,7 @@ namespace Game {
             }
             auto distance_between_cam_and_sel = 0.0f;
             if (draw_cm_id >= 0) {
-               distance_between_cam_and_sel  = glm::length(camera->pos - Physics::get_colliders().states[draw_cm_id].dyn.pos);
+               distance_between_cam_and_sel  = glm::length(camera->pos - Physics::get_colliders().dynamics.pos[draw_cm_id]);
             }
             ImGui::Text("Distance: %0.2f", distance_between_cam_and_sel);
             ImGui::End();
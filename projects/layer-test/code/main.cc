@@ -0,0 +1,191 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Headless check of the layer matrix. set_layer_collision, colliding_layers and
+// should_collide are checked against known rows, then both broadphases run over
+// random boxes with random layers while the matrix changes, and every pair they
+// report has to match a brute force over the boxes that is filtered by the
+// same matrix. Exits with 1 on the first round that doesn't match.
+//
+// usage: layer-test [--bodies n] [--rounds n]
+//
+// (C) 2026 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "core/random.h"
+#include "physics/aabbtree.h"
+#include "physics/broadphase.h"
+#include "physics/phy.h"
+
+
+namespace LayerTest {
+
+    namespace CM = Physics::CollisionMask;
+
+    struct Options {
+        uint32_t bodies = 1024;
+        int rounds = 8;
+    };
+
+    Options parse_options(const int argc, const char** argv) {
+        Options opt;
+        for (auto i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--bodies") == 0 && i + 1 < argc) { opt.bodies = strtoul(argv[++i], nullptr, 10); }
+            else if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) { opt.rounds = atoi(argv[++i]); }
+        }
+        return opt;
+    }
+
+    bool expect(const char* what, const bool ok) {
+        if (!ok) { printf("failed: %s\n", what); }
+        return ok;
+    }
+
+    bool check_matrix(Physics::World& world) {
+        auto ok = true;
+        ok &= expect("physics collides with physics", world.should_collide(CM::Physics, CM::Physics));
+        ok &= expect("audio doesn't collide with physics", !world.should_collide(CM::Audio, CM::Physics));
+        ok &= expect("none collides with nothing", !world.should_collide(CM::None, CM::All));
+        ok &= expect("default physics row", world.colliding_layers(CM::Physics) == CM::Physics);
+        ok &= expect("default audio row", world.colliding_layers(CM::Audio) == 0);
+
+        // the matrix is symmetric, and a mask collides if any of its layers does
+        world.set_layer_collision(CM::AudioSource, CM::Physics | CM::Audio, true);
+        ok &= expect("set is symmetric", world.should_collide(CM::Physics, CM::AudioSource));
+        ok &= expect("set row", world.colliding_layers(CM::AudioSource) == (CM::Physics | CM::Audio));
+        ok &= expect("set column", world.colliding_layers(CM::Audio) == CM::AudioSource);
+        ok &= expect("any layer of the mask", world.should_collide(CM::None | CM::Audio, CM::AudioSource));
+        ok &= expect("union of the rows", world.colliding_layers(CM::Physics | CM::Audio) == (CM::Physics | CM::AudioSource));
+
+        world.set_layer_collision(CM::AudioSource, CM::Physics | CM::Audio, false);
+        ok &= expect("clear is symmetric", !world.should_collide(CM::Physics, CM::AudioSource));
+        ok &= expect("cleared row", world.colliding_layers(CM::AudioSource) == 0);
+        ok &= expect("cleared column", world.colliding_layers(CM::Physics) == CM::Physics);
+        return ok;
+    }
+
+    struct Scene {
+        std::vector<Physics::AABB> aabbs;
+        std::vector<glm::vec3> centers;
+        std::vector<glm::vec3> extents;
+        std::vector<uint8_t> is_static;
+        std::vector<uint8_t> is_awake;
+        std::vector<uint16_t> masks;
+        std::vector<uint16_t> filters;
+        std::vector<uint32_t> awake_bodies;
+        std::vector<uint32_t> static_bodies;
+    };
+
+    // bodies in a box sized so that each overlaps a few others, a quarter of them static
+    Scene make_scene(const uint32_t num_bodies) {
+        constexpr uint16_t layers[] = {
+            CM::Physics, CM::Physics, CM::Audio, CM::AudioSource, CM::None,
+            CM::Physics | CM::Audio, CM::Audio | CM::AudioSource,
+        };
+        Scene scene;
+        const auto extent = std::cbrt(static_cast<float>(num_bodies));
+        for (uint32_t i = 0; i < num_bodies; ++i) {
+            scene.centers.push_back(extent * glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()));
+            scene.extents.push_back(glm::vec3(0.3f) + glm::vec3(Core::RandomFloat(), Core::RandomFloat(), Core::RandomFloat()));
+            scene.is_static.push_back(Core::FastRandom() % 4 == 0);
+            scene.is_awake.push_back(!scene.is_static.back());
+            scene.masks.push_back(layers[Core::FastRandom() % std::size(layers)]);
+            (scene.is_static.back() ? scene.static_bodies : scene.awake_bodies).push_back(i);
+        }
+        scene.aabbs.resize(num_bodies);
+        scene.filters.resize(num_bodies);
+        return scene;
+    }
+
+    void move_bodies(Scene& scene) {
+        for (std::size_t i = 0; i < scene.aabbs.size(); ++i) {
+            if (!scene.is_static[i]) {
+                scene.centers[i] += 0.5f * glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP());
+            }
+            scene.aabbs[i].min_bound = scene.centers[i] - scene.extents[i];
+            scene.aabbs[i].max_bound = scene.centers[i] + scene.extents[i];
+        }
+    }
+
+    using PairList = std::vector<std::pair<uint32_t, uint32_t>>;
+
+    PairList sorted(const std::vector<Physics::AABBPair>& pairs) {
+        PairList list;
+        for (const auto& p : pairs) {
+            list.emplace_back(p.a, p.b);
+        }
+        std::sort(list.begin(), list.end());
+        return list;
+    }
+
+    PairList brute_force(const Physics::World& world, const Scene& scene) {
+        PairList list;
+        for (uint32_t i = 0; i < scene.aabbs.size(); ++i) {
+            for (auto j = i + 1; j < scene.aabbs.size(); ++j) {
+                if (scene.is_static[i] && scene.is_static[j]) { continue; }
+                if (!world.should_collide(scene.masks[i], scene.masks[j])) { continue; }
+                if (scene.aabbs[i].intersect(scene.aabbs[j])) { list.emplace_back(i, j); }
+            }
+        }
+        return list;
+    }
+
+    // a pair whose layers don't collide counts as filtered, the rest have to match the brute force
+    bool check_pairs(const char* name, const Physics::World& world, const Scene& scene, const PairList& found, const PairList& expected) {
+        std::size_t filtered = 0;
+        for (const auto& [a, b] : found) {
+            if (!world.should_collide(scene.masks[a], scene.masks[b])) { ++filtered; }
+        }
+        const auto unique = std::adjacent_find(found.begin(), found.end()) == found.end();
+        printf("%s: %zu pairs, %zu filtered\n", name, found.size(), filtered);
+        return expect(name, filtered == 0 && unique && found == expected);
+    }
+
+} // namespace LayerTest
+
+int main(int argc, const char** argv) {
+    namespace CM = Physics::CollisionMask;
+    const auto opt = LayerTest::parse_options(argc, argv);
+    Core::RandomSeed(1);
+
+    Physics::World world;
+    auto ok = LayerTest::check_matrix(world);
+
+    auto scene = LayerTest::make_scene(opt.bodies);
+    Physics::SweepAndPrune sweep_and_prune;
+    Physics::AABBTree tree;
+    std::vector<Physics::AABBPair> tree_pairs;
+    for (auto round = 0; round < opt.rounds && ok; ++round) {
+        // the matrix changes under both broadphases, the world starts the sweep over when it does
+        if (round % 2 == 1) {
+            const auto collide = round % 4 == 1;
+            world.set_layer_collision(CM::AudioSource, CM::Physics | CM::Audio, collide);
+            world.set_layer_collision(CM::Physics, CM::Physics, !collide);
+            sweep_and_prune.clear();
+        }
+        for (std::size_t i = 0; i < scene.masks.size(); ++i) {
+            scene.filters[i] = world.colliding_layers(scene.masks[i]);
+        }
+
+        LayerTest::move_bodies(scene);
+        sweep_and_prune.update(scene.aabbs, scene.awake_bodies, scene.static_bodies, scene.masks, scene.filters);
+        for (uint32_t i = 0; i < scene.aabbs.size(); ++i) {
+            tree.update(i, scene.aabbs[i]);
+        }
+        tree.find_pairs(scene.aabbs, scene.awake_bodies, scene.is_awake, scene.masks, scene.filters, tree_pairs);
+
+        printf("round %d\n", round);
+        const auto expected = LayerTest::brute_force(world, scene);
+        ok &= LayerTest::check_pairs("sweep and prune", world, scene, LayerTest::sorted(sweep_and_prune.pairs()), expected);
+        ok &= LayerTest::check_pairs("aabb tree", world, scene, LayerTest::sorted(tree_pairs), expected);
+    }
+
+    return ok ? 0 : 1;
+}
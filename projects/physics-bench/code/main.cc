@@ -0,0 +1,179 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Headless ray query benchmark for the physics layer, prints results as json.
+//
+// usage: physics-bench [--rays n] [--threads 1,2,4] [--sizes 64,512,4096] [mesh.glb ...]
+//
+// (C) 2026 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "core/jobsystem.h"
+#include "core/maths.h"
+#include "core/random.h"
+#include "physics/phy.h"
+#include "physics/physicsmesh.h"
+#include "physics/ray.h"
+
+
+namespace Bench {
+
+    struct Options {
+        std::size_t rays = 100000;
+        std::vector<int> threads = {1, 2, 4, 8};
+        std::vector<int> sizes = {64, 512, 4096};
+        std::vector<std::string> meshes;
+    };
+
+    struct Query {
+        glm::vec3 from;
+        glm::vec3 to;
+    };
+
+    std::vector<int> parse_list(const char* s) {
+        std::vector<int> ret;
+        char* end = nullptr;
+        for (auto v = strtol(s, &end, 10); end != s; v = strtol(s, &end, 10)) {
+            ret.push_back(static_cast<int>(v));
+            s = (*end == ',') ? end + 1 : end;
+        }
+        return ret;
+    }
+
+    Options parse_options(const int argc, const char** argv) {
+        Options opt;
+        for (auto i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--rays") == 0 && i + 1 < argc) { opt.rays = strtoul(argv[++i], nullptr, 10); }
+            else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { opt.threads = parse_list(argv[++i]); }
+            else if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) { opt.sizes = parse_list(argv[++i]); }
+            else { opt.meshes.emplace_back(argv[i]); }
+        }
+        if (opt.meshes.empty()) {
+            opt.meshes = {
+                fs::create_path_from_rel_s("assets/system/cube.glb"),
+                fs::create_path_from_rel_s("assets/system/icosphere.glb"),
+                fs::create_path_from_rel_s("assets/space/Asteroid_1_physics.glb"),
+                fs::create_path_from_rel_s("assets/space/Asteroid_4_physics.glb"),
+                fs::create_path_from_rel_s("assets/space/spaceship_physics.glb"),
+            };
+        }
+        return opt;
+    }
+
+    // scatters colliders on a jittered grid so that the scene grows in every direction with its size
+    glm::vec3 grid_position(const int i, const int side) {
+        constexpr auto spacing = 4.0f;
+        const auto x = i % side;
+        const auto y = (i / side) % side;
+        const auto z = i / (side * side);
+        return spacing * glm::vec3(x, y, z) + glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP());
+    }
+
+    // rays handed out per job, small enough to keep every thread busy until the end
+    constexpr std::size_t ray_grain = 256;
+
+    template <typename F>
+    double run_threaded(const std::vector<Query>& queries, const int num_threads, F&& query, std::size_t& hits) {
+        // a pool of its own so every run gets exactly the requested threads, the caller is one of them
+        Core::JobSystem pool(static_cast<uint>(Math::max(num_threads - 1, 0)));
+        std::atomic<std::size_t> total_hits{0};
+        const auto start = std::chrono::steady_clock::now();
+        pool.ParallelFor(queries.size(), ray_grain, [&](const std::size_t first, const std::size_t last) {
+            std::size_t range_hits = 0;
+            for (auto i = first; i < last; ++i) {
+                if (query(queries[i])) { ++range_hits; }
+            }
+            total_hits.fetch_add(range_hits, std::memory_order_relaxed);
+        });
+        const auto end = std::chrono::steady_clock::now();
+        hits = total_hits.load();
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+} // namespace Bench
+
+int main(int argc, const char** argv) {
+    const auto opt = Bench::parse_options(argc, argv);
+
+    std::vector<Physics::ColliderMeshId> meshes;
+    for (const auto& path : opt.meshes) {
+        if (!std::filesystem::exists(path)) {
+            fprintf(stderr, "missing mesh %s\n", path.c_str());
+            continue;
+        }
+        meshes.push_back(Physics::load_collider_mesh(path));
+    }
+    if (meshes.empty()) { return 1; }
+
+    printf("{\n  \"results\": [");
+    auto first_result = true;
+    auto num_colliders = 0;
+    for (const auto size : opt.sizes) {
+        // scenes only ever grow, every size reuses the previous layout
+        const auto side = static_cast<int>(std::ceil(std::cbrt(static_cast<float>(size))));
+        for (; num_colliders < size; ++num_colliders) {
+            const auto mesh = meshes[num_colliders % meshes.size()];
+            const auto rot = glm::angleAxis(
+                Core::RandomFloat() * 2.0f * Math::pi_f, Core::RandomPointOnUnitSphere()
+                );
+            Physics::create_staticbody(
+                mesh, Physics::get_collider_meshes().complex[mesh.index].center,
+                Bench::grid_position(num_colliders, side), rot, 1.0f, Physics::ShapeType::Custom,
+                Physics::CollisionMask::Physics | Physics::CollisionMask::Audio
+                );
+        }
+
+        Physics::AABB bounds;
+        for (const auto& aabb : Physics::get_colliders().aabbs) {
+            bounds.grow(aabb.min_bound);
+            bounds.grow(aabb.max_bound);
+        }
+        const auto random_point = [&]() {
+            return glm::mix(
+                bounds.min_bound, bounds.max_bound, glm::vec3(Core::RandomFloat(), Core::RandomFloat(), Core::RandomFloat())
+                );
+        };
+        std::vector<Bench::Query> queries(opt.rays);
+        for (auto& q : queries) {
+            q.from = random_point();
+            q.to = random_point();
+        }
+
+        const auto closest_hit = [](const Bench::Query& q) {
+            Physics::HitInfo hit;
+            return Physics::cast_ray(Physics::Ray(q.from, q.to - q.from), hit, Physics::CollisionMask::Audio);
+        };
+        const auto line_of_sight = [](const Bench::Query& q) {
+            Physics::HitInfo hit;
+            return !Physics::cast_ray(Physics::Ray(q.from, q.to - q.from, false), hit, Physics::CollisionMask::Audio);
+        };
+
+        for (const auto threads : opt.threads) {
+            for (const auto& [name, hits_name, is_los] : {
+                     std::tuple{"closest_hit", "hits", false},
+                     std::tuple{"line_of_sight", "visible", true}
+                 }) {
+                std::size_t hits;
+                const auto seconds = is_los
+                    ? Bench::run_threaded(queries, threads, line_of_sight, hits)
+                    : Bench::run_threaded(queries, threads, closest_hit, hits);
+                printf(
+                    "%s\n    {\"query\": \"%s\", \"colliders\": %d, \"threads\": %d, \"rays\": %zu, "
+                    "\"%s\": %zu, \"seconds\": %.6f, \"rays_per_sec\": %.1f}",
+                    first_result ? "" : ",", name, num_colliders, threads, queries.size(), hits_name, hits,
+                    seconds, static_cast<double>(queries.size()) / seconds
+                    );
+                first_result = false;
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
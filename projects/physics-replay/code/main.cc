@@ -0,0 +1,309 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Headless physics replay, re-simulates recorded input at fixed steps and prints
+// the time spent in every phase of the step as json.
+//
+// usage: physics-replay record out.rec [--bodies n] [--steps n] [--seed n] [--broadphase 0|1]
+//        physics-replay play in.rec [--repeat n] [--threads n]
+//
+// play exits with 2 if the final state differs from the recorded one.
+//
+// (C) 2026 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "core/cvar.h"
+#include "core/maths.h"
+#include "core/random.h"
+#include "physics/phy.h"
+#include "physics/physicsmesh.h"
+
+
+namespace Replay {
+
+    constexpr uint32_t recording_magic = 0x43455250; // "PREC"
+    constexpr uint32_t recording_version = 1;
+
+    enum class InputType : uint32_t {
+        CenterImpulse = 0,
+        Impulse,
+        Wake,
+    };
+
+    // applied right before the fixed step it belongs to
+    struct Input {
+        uint32_t step;
+        uint32_t collider;
+        InputType type;
+        glm::vec3 loc;
+        glm::vec3 dir;
+    };
+
+    // cvars that change the outcome of a step, a replay runs with the ones it was recorded with
+    struct Settings {
+        int broadphase = 0;
+        int ccd = 1;
+        int allow_sleep = 1;
+        int solver_iterations = 10;
+    };
+
+    struct Recording {
+        std::vector<std::string> meshes;
+        Settings settings;
+        std::vector<uint8_t> initial;
+        uint32_t num_steps = 0;
+        // ordered by step
+        std::vector<Input> inputs;
+        uint64_t final_hash = 0;
+    };
+
+    struct Options {
+        std::string command;
+        std::string path;
+        int bodies = 512;
+        int steps = 600;
+        int seed = 1;
+        int broadphase = 0;
+        int repeat = 3;
+        int threads = 0;
+    };
+
+    Options parse_options(const int argc, const char** argv) {
+        Options opt;
+        if (argc > 1) { opt.command = argv[1]; }
+        if (argc > 2) { opt.path = argv[2]; }
+        for (auto i = 3; i + 1 < argc; i += 2) {
+            const auto v = static_cast<int>(strtol(argv[i + 1], nullptr, 10));
+            if (std::strcmp(argv[i], "--bodies") == 0) { opt.bodies = v; }
+            else if (std::strcmp(argv[i], "--steps") == 0) { opt.steps = v; }
+            else if (std::strcmp(argv[i], "--seed") == 0) { opt.seed = v; }
+            else if (std::strcmp(argv[i], "--broadphase") == 0) { opt.broadphase = v; }
+            else if (std::strcmp(argv[i], "--repeat") == 0) { opt.repeat = v; }
+            else if (std::strcmp(argv[i], "--threads") == 0) { opt.threads = v; }
+        }
+        return opt;
+    }
+
+    uint64_t hash(const std::vector<uint8_t>& data) {
+        auto h = 0xCBF29CE484222325ull;
+        for (const auto b : data) { h = (h ^ b) * 0x100000001B3ull; }
+        return h;
+    }
+
+    template <typename T>
+    void write_array(std::ofstream& file, const std::vector<T>& v) {
+        const auto n = static_cast<uint32_t>(v.size());
+        file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        file.write(reinterpret_cast<const char*>(v.data()), static_cast<std::streamsize>(n * sizeof(T)));
+    }
+
+    template <typename T>
+    bool read_array(std::ifstream& file, std::vector<T>& v) {
+        uint32_t n = 0;
+        if (!file.read(reinterpret_cast<char*>(&n), sizeof(n))) { return false; }
+        v.resize(n);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(v.data()), static_cast<std::streamsize>(n * sizeof(T))));
+    }
+
+    bool save(const std::string& path, const Recording& rec) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&recording_magic), sizeof(recording_magic));
+        file.write(reinterpret_cast<const char*>(&recording_version), sizeof(recording_version));
+        const auto num_meshes = static_cast<uint32_t>(rec.meshes.size());
+        file.write(reinterpret_cast<const char*>(&num_meshes), sizeof(num_meshes));
+        for (const auto& mesh : rec.meshes) {
+            write_array(file, std::vector<char>(mesh.begin(), mesh.end()));
+        }
+        file.write(reinterpret_cast<const char*>(&rec.settings), sizeof(rec.settings));
+        write_array(file, rec.initial);
+        file.write(reinterpret_cast<const char*>(&rec.num_steps), sizeof(rec.num_steps));
+        write_array(file, rec.inputs);
+        file.write(reinterpret_cast<const char*>(&rec.final_hash), sizeof(rec.final_hash));
+        return static_cast<bool>(file);
+    }
+
+    bool load(const std::string& path, Recording& rec) {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t magic = 0, version = 0, num_meshes = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        file.read(reinterpret_cast<char*>(&num_meshes), sizeof(num_meshes));
+        if (!file || magic != recording_magic || version != recording_version) { return false; }
+        for (uint32_t i = 0; i < num_meshes; ++i) {
+            std::vector<char> mesh;
+            if (!read_array(file, mesh)) { return false; }
+            rec.meshes.emplace_back(mesh.begin(), mesh.end());
+        }
+        file.read(reinterpret_cast<char*>(&rec.settings), sizeof(rec.settings));
+        if (!read_array(file, rec.initial)) { return false; }
+        file.read(reinterpret_cast<char*>(&rec.num_steps), sizeof(rec.num_steps));
+        if (!read_array(file, rec.inputs)) { return false; }
+        file.read(reinterpret_cast<char*>(&rec.final_hash), sizeof(rec.final_hash));
+        return static_cast<bool>(file);
+    }
+
+    void apply_settings(const Settings& settings) {
+        Core::CVarWriteInt(Core::CVarGet("s_broadphase"), settings.broadphase);
+        Core::CVarWriteInt(Core::CVarGet("s_ccd"), settings.ccd);
+        Core::CVarWriteInt(Core::CVarGet("s_allow_sleep"), settings.allow_sleep);
+        Core::CVarWriteInt(Core::CVarGet("s_solver_iterations"), settings.solver_iterations);
+    }
+
+    bool load_meshes(Physics::World& world, const std::vector<std::string>& paths) {
+        for (const auto& path : paths) {
+            if (!std::filesystem::exists(path)) {
+                fprintf(stderr, "missing mesh %s\n", path.c_str());
+                return false;
+            }
+            world.load_collider_mesh(path);
+        }
+        return true;
+    }
+
+    // restores the initial state and runs every step with its inputs, returns the hash of the final state
+    uint64_t simulate(Physics::World& world, const Recording& rec) {
+        world.restore(rec.initial);
+        world.reset_step_timings();
+        auto next_input = rec.inputs.begin();
+        for (uint32_t step = 0; step < rec.num_steps; ++step) {
+            for (; next_input != rec.inputs.end() && next_input->step == step; ++next_input) {
+                const auto collider = Physics::ColliderId::Create(next_input->collider);
+                switch (next_input->type) {
+                case InputType::CenterImpulse:
+                    world.add_center_impulse(collider, next_input->dir);
+                    break;
+                case InputType::Impulse:
+                    world.add_impulse(collider, next_input->loc, next_input->dir);
+                    break;
+                case InputType::Wake:
+                    world.wake(collider);
+                    break;
+                }
+            }
+            world.advance(1);
+        }
+        return hash(world.snapshot());
+    }
+
+    // a floor with bodies dropped onto it in a jittered grid, every few steps one of them gets kicked
+    int record(const Options& opt) {
+        Core::RandomSeed(static_cast<uint>(opt.seed));
+
+        Physics::World world;
+        Recording rec;
+        rec.meshes = {
+            fs::create_path_from_rel_s("assets/system/cube.glb"),
+            fs::create_path_from_rel_s("assets/system/icosphere.glb"),
+            fs::create_path_from_rel_s("assets/space/Asteroid_4_physics.glb"),
+        };
+        if (!load_meshes(world, rec.meshes)) { return 1; }
+        rec.settings.broadphase = opt.broadphase;
+        apply_settings(rec.settings);
+
+        const auto& meshes = world.get_collider_meshes().complex;
+        const auto cube = Physics::ColliderMeshId::Create(0);
+        world.create_staticbody(
+            cube, meshes[cube.index].center, glm::vec3(0, -1, 0), glm::quat(1, 0, 0, 0), glm::vec3(100, 1, 100),
+            Physics::ShapeType::Box
+            );
+
+        constexpr Physics::ShapeType shapes[] = {Physics::ShapeType::Box, Physics::ShapeType::Sphere, Physics::ShapeType::Custom};
+        std::vector<Physics::ColliderId> bodies;
+        const auto side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(opt.bodies) / 4.0f)));
+        for (auto i = 0; i < opt.bodies; ++i) {
+            const auto mesh = Physics::ColliderMeshId::Create(static_cast<uint32_t>(i % 3));
+            const auto pos = glm::vec3(
+                1.5f * static_cast<float>(i % side - side / 2),
+                1.0f + 1.5f * static_cast<float>(i / (side * side)),
+                1.5f * static_cast<float>((i / side) % side - side / 2)
+                ) + 0.2f * glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP());
+            const auto rot = glm::angleAxis(Core::RandomFloat() * 2.0f * Math::pi_f, Core::RandomPointOnUnitSphere());
+            bodies.push_back(world.create_rigidbody(
+                mesh, meshes[mesh.index].center, pos, rot, 0.5f, 1.0f, shapes[i % 3]
+                ));
+        }
+
+        constexpr auto kick_interval = 15u;
+        rec.num_steps = static_cast<uint32_t>(opt.steps);
+        for (auto step = kick_interval; step < rec.num_steps; step += kick_interval) {
+            const auto body = bodies[Core::FastRandom() % bodies.size()];
+            const auto dir = 5.0f * Core::RandomPointOnUnitSphere() + glm::vec3(0, 5, 0);
+            rec.inputs.push_back({step, static_cast<uint32_t>(body), InputType::CenterImpulse, glm::vec3(0), dir});
+        }
+
+        rec.initial = world.snapshot();
+        rec.final_hash = simulate(world, rec);
+        if (!save(opt.path, rec)) {
+            fprintf(stderr, "could not write %s\n", opt.path.c_str());
+            return 1;
+        }
+        printf(
+            "{\"recorded\": \"%s\", \"colliders\": %zu, \"steps\": %u, \"inputs\": %zu, \"hash\": \"%016llx\"}\n",
+            opt.path.c_str(), world.get_colliders().ids.size(), rec.num_steps, rec.inputs.size(),
+            static_cast<unsigned long long>(rec.final_hash)
+            );
+        return 0;
+    }
+
+    int play(const Options& opt) {
+        Physics::World world;
+        Recording rec;
+        if (!load(opt.path, rec)) {
+            fprintf(stderr, "could not read %s\n", opt.path.c_str());
+            return 1;
+        }
+        if (!load_meshes(world, rec.meshes)) { return 1; }
+        apply_settings(rec.settings);
+        Core::CVarWriteInt(Core::CVarGet("s_narrowphase_threads"), opt.threads);
+        if (!world.restore(rec.initial)) {
+            fprintf(stderr, "the initial state of %s doesn't fit the meshes\n", opt.path.c_str());
+            return 1;
+        }
+
+        printf(
+            "{\n  \"recording\": \"%s\", \"colliders\": %zu, \"steps\": %u, \"threads\": %d,\n  \"runs\": [",
+            opt.path.c_str(), world.get_colliders().ids.size(), rec.num_steps, opt.threads
+            );
+        auto deterministic = true;
+        for (auto run = 0; run < opt.repeat; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            const auto final_hash = simulate(world, rec);
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            deterministic &= final_hash == rec.final_hash;
+
+            // milliseconds per step
+            const auto& t = world.get_step_timings();
+            const auto ms = [&t](const double phase) { return 1000.0 * phase / Math::max(t.steps, 1u); };
+            printf(
+                "%s\n    {\"seconds\": %.6f, \"hash\": \"%016llx\", \"matches\": %s, \"ms_per_step\": {"
+                "\"integrate_forces\": %.4f, \"ccd\": %.4f, \"broadphase\": %.4f, \"narrowphase\": %.4f, "
+                "\"solver\": %.4f, \"integrate_motion\": %.4f, \"islands\": %.4f}}",
+                run == 0 ? "" : ",", seconds, static_cast<unsigned long long>(final_hash),
+                final_hash == rec.final_hash ? "true" : "false", ms(t.integrate_forces), ms(t.ccd), ms(t.broadphase),
+                ms(t.narrowphase), ms(t.solver), ms(t.integrate_motion), ms(t.islands)
+                );
+        }
+        printf("\n  ],\n  \"deterministic\": %s\n}\n", deterministic ? "true" : "false");
+        return deterministic ? 0 : 2;
+    }
+
+} // namespace Replay
+
+int main(int argc, const char** argv) {
+    const auto opt = Replay::parse_options(argc, argv);
+    Physics::init_debug();
+    if (opt.command == "record" && !opt.path.empty()) { return Replay::record(opt); }
+    if (opt.command == "play" && !opt.path.empty()) { return Replay::play(opt); }
+    fprintf(stderr, "usage: physics-replay record out.rec [--bodies n] [--steps n] [--seed n] [--broadphase 0|1]\n"
+        "       physics-replay play in.rec [--repeat n] [--threads n]\n");
+    return 1;
+}